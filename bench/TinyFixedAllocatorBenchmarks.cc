@@ -0,0 +1,353 @@
+#include <TinyFixedAllocator.hh>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define TINY_FIXED_ALLOCATOR_BENCHMARK_PMR 1
+#endif
+
+//
+// Single-threaded allocation workloads replayed against FixedAllocator configurations, malloc and
+// std::pmr::unsynchronized_pool_resource. Every allocator replays the same pre-generated trace (fixed seed),
+// so the numbers are comparable between runs and between allocators.
+//
+// Usage: TinyFixedAllocatorBenchmarks [--ops N] [--seed S] [--filter substring]
+//
+
+namespace {
+
+using namespace apemode;
+
+using Clock = std::chrono::steady_clock;
+
+enum class SizeDistribution { Uniform, PowerLaw };
+enum class FreeOrder { Lifo, Fifo, Random };
+
+struct Workload {
+    const char* name = "";
+    SizeDistribution sizes = SizeDistribution::Uniform;
+    FreeOrder freeOrder = FreeOrder::Random;
+    size_t liveTarget = 0;
+    double longLivedFraction = 0.0;
+};
+
+struct Op {
+    uint32_t id = 0;
+    uint32_t size = 0;
+    bool alloc = false;
+};
+
+struct Trace {
+    std::vector<Op> ops{};
+    size_t idCount = 0;
+};
+
+uint32_t sampleSize(SizeDistribution sizes, std::mt19937& rng) {
+    if (sizes == SizeDistribution::Uniform) { return 16 + rng() % (512 - 16 + 1); }
+
+    //
+    // Pareto with alpha 1.2 starting at 16 bytes, capped at 64 KB: mostly small, with a long tail.
+    //
+
+    double u = (rng() + 1.0) / (double(std::mt19937::max()) + 2.0);
+    double size = 16.0 / std::pow(u, 1.0 / 1.2);
+    return static_cast<uint32_t>(std::min(size, 65536.0));
+}
+
+//
+// Allocations fill the live set up to liveTarget, then allocs and frees alternate randomly around it.
+// Long-lived blocks are never picked for freeing and are released at the end of the trace.
+//
+
+Trace generateTrace(const Workload& workload, size_t opCount, uint32_t seed) {
+    std::mt19937 rng(seed);
+    Trace trace = {};
+    trace.ops.reserve(opCount + workload.liveTarget * 2);
+
+    std::vector<uint32_t> live = {};
+    std::vector<uint32_t> longLived = {};
+    size_t liveFront = 0;
+
+    while (trace.ops.size() < opCount) {
+        size_t liveCount = live.size() - liveFront;
+        bool alloc = liveCount < workload.liveTarget / 2 || (liveCount < workload.liveTarget * 2 && rng() % 2);
+
+        if (alloc) {
+            uint32_t id = static_cast<uint32_t>(trace.idCount++);
+            trace.ops.push_back({id, sampleSize(workload.sizes, rng), true});
+
+            bool isLongLived = workload.longLivedFraction > 0.0 && (rng() % 10000) < workload.longLivedFraction * 10000;
+            (isLongLived ? longLived : live).push_back(id);
+            continue;
+        }
+
+        size_t i = 0;
+        switch (workload.freeOrder) {
+        case FreeOrder::Lifo: i = live.size() - 1; break;
+        case FreeOrder::Fifo: i = liveFront; break;
+        case FreeOrder::Random: i = liveFront + rng() % liveCount; break;
+        }
+
+        trace.ops.push_back({live[i], 0, false});
+        if (workload.freeOrder == FreeOrder::Fifo) {
+            ++liveFront;
+        } else {
+            live[i] = live.back();
+            live.pop_back();
+        }
+    }
+
+    for (size_t i = liveFront; i < live.size(); ++i) { trace.ops.push_back({live[i], 0, false}); }
+    for (uint32_t id : longLived) { trace.ops.push_back({id, 0, false}); }
+    return trace;
+}
+
+//
+// Allocator adapters.
+//
+
+struct MallocAdapter {
+    static const char* name() { return "malloc"; }
+    void* alloc(uint32_t size) { return std::malloc(size); }
+    void free(void* p, uint32_t) { std::free(p); }
+    double fragmentation() const { return -1.0; }
+    size_t metadataBytes() const { return 0; }
+};
+
+#if defined(TINY_FIXED_ALLOCATOR_BENCHMARK_PMR)
+struct PmrPoolAdapter {
+    std::pmr::unsynchronized_pool_resource resource{};
+
+    static const char* name() { return "pmr::unsynchronized_pool"; }
+    void* alloc(uint32_t size) { return resource.allocate(size); }
+    void free(void* p, uint32_t size) { resource.deallocate(p, size); }
+    double fragmentation() const { return -1.0; }
+    size_t metadataBytes() const { return 0; }
+};
+#endif
+
+template <typename SizeType, typename RangeVectorType>
+size_t storeMetadataBytes(const FixedAllocatorRangeVector<SizeType, RangeVectorType>& store) {
+    return store.ranges.capacity() * sizeof(FixedAllocatorRange<SizeType>);
+}
+
+template <typename SizeType, typename MapType>
+size_t storeMetadataBytes(const FixedAllocatorRangeTree<SizeType, MapType>& store) {
+    return store.ranges.size() * (sizeof(typename MapType::value_type) + 4 * sizeof(void*));
+}
+
+template <typename SizeType, uint32_t SecondLevelLog2, SizeType MinBlockSize>
+size_t storeMetadataBytes(const FixedAllocatorTlsfRanges<SizeType, SecondLevelLog2, MinBlockSize>& store) {
+    return sizeof(store) + (store.usedStarts.capacity() + store.usedEnds.capacity()) * sizeof(uint64_t);
+}
+
+template <typename AllocatorType>
+struct FixedAdapter {
+    static constexpr size_t containerSize = size_t(128) * 1024 * 1024;
+
+    //
+    // The buffer is left uninitialized, so only the pages the workload touches get committed.
+    //
+
+    const char* adapterName = "";
+    std::unique_ptr<uint8_t[]> buffer{new uint8_t[containerSize]};
+    AllocatorType allocator{defaults::ByteSpan(buffer.get(), containerSize)};
+
+    explicit FixedAdapter(const char* n) : adapterName(n) {}
+
+    const char* name() const { return adapterName; }
+    void* alloc(uint32_t size) { return allocator.alloc(static_cast<typename AllocatorType::size_type>(size)); }
+    void free(void* p, uint32_t) { allocator.free(p); }
+    double fragmentation() const { return allocator.stats().fragmentation(); }
+
+    //
+    // Free list storage plus the block headers of the live allocations.
+    //
+
+    size_t metadataBytes() const {
+        auto stats = allocator.stats();
+        return storeMetadataBytes(allocator.freeBufferRanges) +
+               stats.liveAllocations * (AllocatorType::headerSize + AllocatorType::trailerSize);
+    }
+};
+
+struct Result {
+    double opsPerSecond = 0.0;
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double p999 = 0.0;
+    double peakFragmentation = -1.0;
+    size_t peakMetadataBytes = 0;
+    size_t failedAllocs = 0;
+};
+
+//
+// Replays the trace twice: untimed per op for throughput, then with a clock read around every op for percentiles.
+// Fragmentation and metadata are sampled every 1024 ops of the first pass.
+//
+
+template <typename Adapter>
+Result replay(Adapter& adapter, const Trace& trace) {
+    Result result = {};
+    std::vector<void*> ptrs(trace.idCount, nullptr);
+    std::vector<uint32_t> sizes(trace.idCount, 0);
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < trace.ops.size(); ++i) {
+        const Op& op = trace.ops[i];
+        if (op.alloc) {
+            ptrs[op.id] = adapter.alloc(op.size);
+            sizes[op.id] = op.size;
+            if (!ptrs[op.id]) { ++result.failedAllocs; }
+        } else if (ptrs[op.id]) {
+            adapter.free(ptrs[op.id], sizes[op.id]);
+            ptrs[op.id] = nullptr;
+        }
+
+        if ((i & 1023) == 0) {
+            result.peakFragmentation = std::max(result.peakFragmentation, adapter.fragmentation());
+            result.peakMetadataBytes = std::max(result.peakMetadataBytes, adapter.metadataBytes());
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.opsPerSecond = seconds > 0.0 ? trace.ops.size() / seconds : 0.0;
+
+    std::vector<uint32_t> latencies = {};
+    latencies.reserve(trace.ops.size());
+    for (const Op& op : trace.ops) {
+        auto opStart = Clock::now();
+        if (op.alloc) {
+            ptrs[op.id] = adapter.alloc(op.size);
+        } else if (ptrs[op.id]) {
+            adapter.free(ptrs[op.id], sizes[op.id]);
+            ptrs[op.id] = nullptr;
+        }
+
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - opStart).count();
+        latencies.push_back(static_cast<uint32_t>(std::min<int64_t>(ns, UINT32_MAX)));
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double q) { return latencies.empty() ? 0.0 : double(latencies[size_t(q * (latencies.size() - 1))]); };
+    result.p50 = percentile(0.50);
+    result.p99 = percentile(0.99);
+    result.p999 = percentile(0.999);
+    return result;
+}
+
+struct Options {
+    size_t opCount = 200000;
+    uint32_t seed = 1;
+    std::string filter{};
+};
+
+void printHeader() {
+    std::printf("%-28s %-32s %12s %9s %9s %9s %10s %12s %8s\n",
+                "workload", "allocator", "ops/s", "p50 ns", "p99 ns", "p99.9 ns", "peak frag", "metadata KB", "failed");
+}
+
+template <typename Adapter>
+void run(const Options& options, const Workload& workload, const Trace& trace, Adapter& adapter) {
+    std::string label = std::string(workload.name) + " " + adapter.name();
+    if (!options.filter.empty() && label.find(options.filter) == std::string::npos) { return; }
+
+    Result r = replay(adapter, trace);
+    std::printf("%-28s %-32s %12.0f %9.0f %9.0f %9.0f ", workload.name, adapter.name(), r.opsPerSecond, r.p50, r.p99, r.p999);
+    if (r.peakFragmentation >= 0.0) {
+        std::printf("%10.3f %12.1f %8zu\n", r.peakFragmentation, r.peakMetadataBytes / 1024.0, r.failedAllocs);
+    } else {
+        std::printf("%10s %12s %8zu\n", "-", "-", r.failedAllocs);
+    }
+}
+
+template <typename AllocatorType>
+void runFixed(const Options& options, const Workload& workload, const Trace& trace, const char* name) {
+    auto adapter = std::make_unique<FixedAdapter<AllocatorType>>(name);
+    run(options, workload, trace, *adapter);
+}
+
+template <typename SizeType, typename RangeVectorType, typename FitPolicy, typename BlockFormat = defaults::SizeHeaderBlockFormat>
+using BenchmarkAllocator = FixedAllocator<SizeType,
+                                          defaults::ByteSpan,
+                                          RangeVectorType,
+                                          defaults::DefaultExceptionPolicy,
+                                          defaults::DefaultSingleThreadedLockPolicy,
+                                          FitPolicy,
+                                          BlockFormat>;
+
+template <typename SizeType>
+using RangeVector = std::vector<FixedAllocatorRange<SizeType>>;
+
+void runWorkload(const Options& options, const Workload& workload) {
+    Trace trace = generateTrace(workload, options.opCount, options.seed);
+
+    {
+        MallocAdapter adapter;
+        run(options, workload, trace, adapter);
+    }
+
+#if defined(TINY_FIXED_ALLOCATOR_BENCHMARK_PMR)
+    {
+        PmrPoolAdapter adapter;
+        run(options, workload, trace, adapter);
+    }
+#endif
+
+    runFixed<BenchmarkAllocator<uint32_t, RangeVector<uint32_t>, defaults::FirstFitPolicy>>(options, workload, trace, "u32 vector first-fit");
+    runFixed<BenchmarkAllocator<uint64_t, RangeVector<uint64_t>, defaults::FirstFitPolicy>>(options, workload, trace, "u64 vector first-fit");
+    runFixed<BenchmarkAllocator<uint32_t, RangeVector<uint32_t>, defaults::NextFitPolicy>>(options, workload, trace, "u32 vector next-fit");
+    runFixed<BenchmarkAllocator<uint32_t, RangeVector<uint32_t>, defaults::BestFitPolicy>>(options, workload, trace, "u32 vector best-fit");
+    runFixed<BenchmarkAllocator<uint32_t, FixedAllocatorRangeTree<uint32_t>, defaults::BestFitPolicy>>(options, workload, trace, "u32 tree best-fit");
+    runFixed<BenchmarkAllocator<uint32_t, FixedAllocatorRangeTree<uint32_t>, defaults::FirstFitPolicy,
+                                defaults::BoundaryTagBlockFormat>>(options, workload, trace, "u32 tree first-fit tags");
+    runFixed<BenchmarkAllocator<uint32_t, FixedAllocatorTlsfRanges<uint32_t>, defaults::FirstFitPolicy>>(options, workload, trace, "u32 tlsf");
+    runFixed<BenchmarkAllocator<uint64_t, FixedAllocatorTlsfRanges<uint64_t>, defaults::FirstFitPolicy,
+                                defaults::BoundaryTagBlockFormat>>(options, workload, trace, "u64 tlsf tags");
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options = {};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        if (key == "--ops") {
+            options.opCount = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (key == "--seed") {
+            options.seed = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+        } else if (key == "--filter") {
+            options.filter = argv[i + 1];
+        }
+    }
+
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+
+    const Workload workloads[] = {
+        {"uniform-lifo", SizeDistribution::Uniform, FreeOrder::Lifo, 1024, 0.0},
+        {"uniform-fifo", SizeDistribution::Uniform, FreeOrder::Fifo, 1024, 0.0},
+        {"uniform-random", SizeDistribution::Uniform, FreeOrder::Random, 4096, 0.0},
+        {"powerlaw-lifo", SizeDistribution::PowerLaw, FreeOrder::Lifo, 1024, 0.0},
+        {"powerlaw-random", SizeDistribution::PowerLaw, FreeOrder::Random, 4096, 0.0},
+        {"mixed-lifetimes", SizeDistribution::PowerLaw, FreeOrder::Random, 2048, 0.05},
+        {"steady-fragmentation", SizeDistribution::PowerLaw, FreeOrder::Random, 16384, 0.0},
+    };
+
+    std::printf("ops=%zu seed=%u\n", options.opCount, options.seed);
+    printHeader();
+    for (const Workload& workload : workloads) { runWorkload(options, workload); }
+    return 0;
+}
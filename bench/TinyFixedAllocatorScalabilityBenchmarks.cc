@@ -0,0 +1,312 @@
+#include <TinyFixedAllocator.hh>
+#include <TinyFixedThreadCache.hh>
+#include <TinyFixedShardedAllocator.hh>
+#include <taskflow/taskflow.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Multi-threaded scalability sweep: thread counts from 1 to hardware_concurrency, lock policies, front ends
+// (thread cache, shards) and container sizes. Workers run as Taskflow tasks and do no I/O while timed.
+// Two patterns: "local" (every thread frees its own blocks) and "producer-consumer" (half of the threads allocate,
+// their partners free the blocks on another thread).
+// Throughput counts every alloc and free, latencies are sampled on one op in 32 per thread.
+//
+// Usage: TinyFixedAllocatorScalabilityBenchmarks [--ops N] [--max-threads N] [--filter substring]
+//
+
+namespace {
+
+using namespace apemode;
+
+using Clock = std::chrono::steady_clock;
+
+enum class Pattern { Local, ProducerConsumer };
+
+constexpr size_t latencySampleRate = 32;
+
+struct Options {
+    size_t opsPerThread = 200000;
+    size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::string filter{};
+};
+
+struct Result {
+    double opsPerSecond = 0.0;
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double p999 = 0.0;
+};
+
+uint32_t sampleLatency(Clock::time_point start) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    return static_cast<uint32_t>(std::min<int64_t>(ns, UINT32_MAX));
+}
+
+//
+// Bounded single-producer single-consumer ring used to hand blocks over to the freeing thread.
+//
+
+struct BlockRing {
+    static constexpr size_t capacity = 1024;
+
+    void* slots[capacity] = {};
+    alignas(64) std::atomic<size_t> head = {0};
+    alignas(64) std::atomic<size_t> tail = {0};
+    std::atomic<bool> done = {false};
+
+    bool push(void* p) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == capacity) { return false; }
+
+        slots[t % capacity] = p;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    void* pop() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) { return nullptr; }
+
+        void* p = slots[h % capacity];
+        head.store(h + 1, std::memory_order_release);
+        return p;
+    }
+};
+
+//
+// Front ends give every worker its own view of the shared allocator.
+//
+
+template <typename AllocatorType>
+struct DirectFrontend {
+    AllocatorType& allocator;
+
+    explicit DirectFrontend(AllocatorType& a) : allocator(a) {}
+    void* alloc(uint32_t size) { return allocator.alloc(static_cast<typename AllocatorType::size_type>(size)); }
+    void free(void* p) { allocator.free(p); }
+};
+
+template <typename AllocatorType>
+struct CachedFrontend {
+    FixedAllocatorThreadCache<AllocatorType> cache;
+
+    explicit CachedFrontend(AllocatorType& a) : cache(a) {}
+    void* alloc(uint32_t size) { return cache.alloc(static_cast<typename AllocatorType::size_type>(size)); }
+    void free(void* p) { cache.free(p); }
+};
+
+template <typename Frontend, typename AllocatorType>
+void localWorker(AllocatorType& allocator, size_t seed, size_t opCount, std::atomic<size_t>& totalOps, std::vector<uint32_t>& latencies) {
+    Frontend frontend(allocator);
+    std::mt19937 rng(static_cast<uint32_t>(seed));
+
+    void* slots[64] = {};
+    size_t ops = 0;
+    for (size_t i = 0; i < opCount; ++i) {
+        size_t slot = rng() % 64;
+        uint32_t size = 16 + rng() % 1009;
+        bool sampled = i % latencySampleRate == 0;
+        auto start = sampled ? Clock::now() : Clock::time_point{};
+
+        if (slots[slot]) {
+            frontend.free(slots[slot]);
+            slots[slot] = nullptr;
+        } else {
+            slots[slot] = frontend.alloc(size);
+        }
+
+        if (sampled) { latencies.push_back(sampleLatency(start)); }
+        ++ops;
+    }
+
+    for (void*& p : slots) {
+        if (p) { frontend.free(p); ++ops; }
+    }
+
+    totalOps.fetch_add(ops, std::memory_order_relaxed);
+}
+
+template <typename Frontend, typename AllocatorType>
+void producerWorker(AllocatorType& allocator, size_t seed, size_t opCount, BlockRing& ring, std::atomic<size_t>& totalOps, std::vector<uint32_t>& latencies) {
+    Frontend frontend(allocator);
+    std::mt19937 rng(static_cast<uint32_t>(seed));
+
+    size_t ops = 0;
+    for (size_t i = 0; i < opCount; ++i) {
+        bool sampled = i % latencySampleRate == 0;
+        auto start = sampled ? Clock::now() : Clock::time_point{};
+
+        void* p = frontend.alloc(16 + rng() % 1009);
+        if (sampled) { latencies.push_back(sampleLatency(start)); }
+        ++ops;
+
+        if (!p) { continue; }
+        while (!ring.push(p)) { std::this_thread::yield(); }
+    }
+
+    ring.done.store(true, std::memory_order_release);
+    totalOps.fetch_add(ops, std::memory_order_relaxed);
+}
+
+template <typename Frontend, typename AllocatorType>
+void consumerWorker(AllocatorType& allocator, BlockRing& ring, std::atomic<size_t>& totalOps, std::vector<uint32_t>& latencies) {
+    Frontend frontend(allocator);
+
+    size_t ops = 0;
+    for (;;) {
+        bool done = ring.done.load(std::memory_order_acquire);
+        void* p = ring.pop();
+        if (!p) {
+            if (done) { break; }
+
+            std::this_thread::yield();
+            continue;
+        }
+
+        bool sampled = ops % latencySampleRate == 0;
+        auto start = sampled ? Clock::now() : Clock::time_point{};
+
+        frontend.free(p);
+        if (sampled) { latencies.push_back(sampleLatency(start)); }
+        ++ops;
+    }
+
+    totalOps.fetch_add(ops, std::memory_order_relaxed);
+}
+
+template <typename Frontend, typename AllocatorType>
+Result runPattern(AllocatorType& allocator, Pattern pattern, size_t threadCount, size_t opsPerThread) {
+    tf::Executor executor(threadCount);
+    tf::Taskflow taskflow;
+
+    std::atomic<size_t> totalOps = {0};
+    std::vector<std::vector<uint32_t>> latencies(threadCount);
+    std::vector<std::unique_ptr<BlockRing>> rings = {};
+    for (auto& l : latencies) { l.reserve(opsPerThread / latencySampleRate + 64); }
+
+    if (pattern == Pattern::Local) {
+        for (size_t t = 0; t < threadCount; ++t) {
+            taskflow.emplace([&, t]() { localWorker<Frontend>(allocator, t + 1, opsPerThread, totalOps, latencies[t]); });
+        }
+    } else {
+        for (size_t t = 0; t + 1 < threadCount; t += 2) {
+            rings.emplace_back(new BlockRing());
+            BlockRing& ring = *rings.back();
+            taskflow.emplace([&, t]() { producerWorker<Frontend>(allocator, t + 1, opsPerThread, ring, totalOps, latencies[t]); });
+            taskflow.emplace([&, t]() { consumerWorker<Frontend>(allocator, ring, totalOps, latencies[t + 1]); });
+        }
+    }
+
+    auto start = Clock::now();
+    executor.run(taskflow).wait();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<uint32_t> merged = {};
+    for (auto& l : latencies) { merged.insert(merged.end(), l.begin(), l.end()); }
+    std::sort(merged.begin(), merged.end());
+
+    auto percentile = [&](double q) { return merged.empty() ? 0.0 : double(merged[size_t(q * (merged.size() - 1))]); };
+
+    Result result = {};
+    result.opsPerSecond = seconds > 0.0 ? totalOps.load() / seconds : 0.0;
+    result.p50 = percentile(0.50);
+    result.p99 = percentile(0.99);
+    result.p999 = percentile(0.999);
+    return result;
+}
+
+template <typename LockPolicy>
+using ScalabilityAllocator = FixedAllocator<uint32_t,
+                                            defaults::ByteSpan,
+                                            FixedAllocatorTlsfRanges<uint32_t>,
+                                            defaults::DefaultExceptionPolicy,
+                                            LockPolicy>;
+
+std::vector<size_t> threadCounts(size_t maxThreads) {
+    std::vector<size_t> counts = {};
+    for (size_t n = 1; n < maxThreads; n *= 2) { counts.push_back(n); }
+    counts.push_back(maxThreads);
+    return counts;
+}
+
+const char* patternName(Pattern pattern) {
+    return pattern == Pattern::Local ? "local" : "producer-consumer";
+}
+
+//
+// A fresh allocator per run, built by makeAllocator(span, threadCount).
+//
+
+template <typename AllocatorType, typename Frontend, typename MakeAllocator>
+void sweep(const Options& options, const char* name, size_t containerSize, MakeAllocator&& makeAllocator) {
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[containerSize]);
+
+    for (Pattern pattern : {Pattern::Local, Pattern::ProducerConsumer}) {
+        std::string label = std::string(patternName(pattern)) + " " + name;
+        if (!options.filter.empty() && label.find(options.filter) == std::string::npos) { continue; }
+
+        for (size_t threadCount : threadCounts(options.maxThreads)) {
+            if (pattern == Pattern::ProducerConsumer && threadCount < 2) { continue; }
+
+            std::unique_ptr<AllocatorType> allocator = makeAllocator(defaults::ByteSpan(buffer.get(), containerSize), threadCount);
+            Result r = runPattern<Frontend>(*allocator, pattern, threadCount, options.opsPerThread);
+            std::printf("%-18s %-26s %8zu %8zu %12.2f %9.0f %9.0f %9.0f\n",
+                        patternName(pattern), name, containerSize >> 20, threadCount, r.opsPerSecond / 1e6, r.p50, r.p99, r.p999);
+        }
+    }
+}
+
+template <typename LockPolicy>
+void sweepLockPolicy(const Options& options, const char* name, const char* cachedName, const char* shardedName, size_t containerSize) {
+    using AllocatorType = ScalabilityAllocator<LockPolicy>;
+    using ShardedType = ShardedFixedAllocator<AllocatorType>;
+
+    auto makeAllocator = [](const defaults::ByteSpan& span, size_t) { return std::make_unique<AllocatorType>(span); };
+    auto makeSharded = [](const defaults::ByteSpan& span, size_t threadCount) { return std::make_unique<ShardedType>(span, threadCount); };
+
+    sweep<AllocatorType, DirectFrontend<AllocatorType>>(options, name, containerSize, makeAllocator);
+    sweep<AllocatorType, CachedFrontend<AllocatorType>>(options, cachedName, containerSize, makeAllocator);
+    sweep<ShardedType, DirectFrontend<ShardedType>>(options, shardedName, containerSize, makeSharded);
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options = {};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        if (key == "--ops") {
+            options.opsPerThread = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (key == "--max-threads") {
+            options.maxThreads = std::max<size_t>(1, std::strtoull(argv[i + 1], nullptr, 10));
+        } else if (key == "--filter") {
+            options.filter = argv[i + 1];
+        }
+    }
+
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+
+    std::printf("opsPerThread=%zu maxThreads=%zu\n", options.opsPerThread, options.maxThreads);
+    std::printf("%-18s %-26s %8s %8s %12s %9s %9s %9s\n", "pattern", "allocator", "size MB", "threads", "Mops/s", "p50 ns", "p99 ns", "p99.9 ns");
+
+    for (size_t containerSize : {size_t(16) << 20, size_t(256) << 20}) {
+        sweepLockPolicy<defaults::DefaultMultiThreadedLockPolicy>(options, "spin", "spin+cache", "spin+shards", containerSize);
+        sweepLockPolicy<defaults::BackoffSpinLockPolicy>(options, "backoff", "backoff+cache", "backoff+shards", containerSize);
+        sweepLockPolicy<defaults::SharedSpinLockPolicy>(options, "shared-spin", "shared-spin+cache", "shared-spin+shards", containerSize);
+        sweepLockPolicy<defaults::FutexLockPolicy>(options, "futex", "futex+cache", "futex+shards", containerSize);
+    }
+
+    return 0;
+}
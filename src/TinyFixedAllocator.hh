@@ -1,8 +1,38 @@
+#pragma once
+
 #include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
 #include <iostream>
 #include <atomic>
 #include <mutex>
 #include <shared_mutex>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <iterator>
+#include <algorithm>
+#include <utility>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace apemode {
 namespace defaults {
@@ -54,6 +84,187 @@ struct DefaultMultiThreadedLockPolicy {
     using SharedLockGuard = std::shared_lock<Lock>;
 };
 
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+//
+// Exponential backoff for spinning waiters: pause for 1, 2, 4, ... iterations, then yield the thread.
+//
+
+struct Backoff {
+    static constexpr uint32_t maxSpins = 1024;
+    uint32_t spins = 1;
+
+    void operator()() {
+        if (spins <= maxSpins) {
+            for (uint32_t i = 0; i < spins; ++i) { cpuRelax(); }
+            spins <<= 1;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+};
+
+//
+// Test-and-test-and-set lock, waiters spin on a plain load with backoff instead of hammering the cache line.
+//
+
+struct BackoffSpinLock {
+    std::atomic<bool> locked = {false};
+    std::atomic<uint64_t> contentionCount = {0};
+
+    bool try_lock() {
+        return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void lock() {
+        if (try_lock()) { return; }
+
+        contentionCount.fetch_add(1, std::memory_order_relaxed);
+        Backoff backoff;
+        do {
+            while (locked.load(std::memory_order_relaxed)) { backoff(); }
+        } while (locked.exchange(true, std::memory_order_acquire));
+    }
+
+    void unlock() { locked.store(false, std::memory_order_release); }
+    void lock_shared() { lock(); }
+    void unlock_shared() { unlock(); }
+    uint64_t contentions() const { return contentionCount.load(std::memory_order_relaxed); }
+};
+
+//
+// Reader-writer spin lock, readers share the lock and a waiting writer stops new readers from entering.
+//
+
+struct SharedSpinLock {
+    static constexpr uint32_t writerBit = 1u << 31;
+    static constexpr uint32_t pendingWriterBit = 1u << 30;
+
+    std::atomic<uint32_t> state = {0};
+    std::atomic<uint64_t> contentionCount = {0};
+
+    void lock() {
+        uint32_t s = 0;
+        if (state.compare_exchange_strong(s, writerBit, std::memory_order_acquire)) { return; }
+
+        contentionCount.fetch_add(1, std::memory_order_relaxed);
+        Backoff backoff;
+        for (;;) {
+            s = state.load(std::memory_order_relaxed);
+            if (!(s & ~pendingWriterBit)) {
+                if (state.compare_exchange_weak(s, writerBit, std::memory_order_acquire)) { return; }
+            } else if (!(s & pendingWriterBit)) {
+                state.fetch_or(pendingWriterBit, std::memory_order_relaxed);
+            }
+
+            backoff();
+        }
+    }
+
+    void unlock() { state.fetch_and(~writerBit, std::memory_order_release); }
+
+    void lock_shared() {
+        uint32_t s = state.load(std::memory_order_relaxed);
+        if (!(s & (writerBit | pendingWriterBit)) && state.compare_exchange_strong(s, s + 1, std::memory_order_acquire)) {
+            return;
+        }
+
+        contentionCount.fetch_add(1, std::memory_order_relaxed);
+        Backoff backoff;
+        for (;;) {
+            s = state.load(std::memory_order_relaxed);
+            if (!(s & (writerBit | pendingWriterBit)) && state.compare_exchange_weak(s, s + 1, std::memory_order_acquire)) {
+                return;
+            }
+
+            backoff();
+        }
+    }
+
+    void unlock_shared() { state.fetch_sub(1, std::memory_order_release); }
+    uint64_t contentions() const { return contentionCount.load(std::memory_order_relaxed); }
+};
+
+//
+// Blocking lock that parks waiters in the kernel instead of spinning.
+// On Linux it is the three-state futex mutex (0 - unlocked, 1 - locked, 2 - locked with waiters),
+// elsewhere it falls back to std::mutex.
+//
+
+struct FutexLock {
+    std::atomic<uint64_t> contentionCount = {0};
+
+#if defined(__linux__)
+    std::atomic<uint32_t> state = {0};
+
+    static void futexWait(std::atomic<uint32_t>* addr, uint32_t expected) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+    }
+
+    static void futexWake(std::atomic<uint32_t>* addr, int count) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+
+    void lock() {
+        uint32_t c = 0;
+        if (state.compare_exchange_strong(c, 1, std::memory_order_acquire)) { return; }
+
+        contentionCount.fetch_add(1, std::memory_order_relaxed);
+        if (c != 2) { c = state.exchange(2, std::memory_order_acquire); }
+        while (c != 0) {
+            futexWait(&state, 2);
+            c = state.exchange(2, std::memory_order_acquire);
+        }
+    }
+
+    void unlock() {
+        if (state.fetch_sub(1, std::memory_order_release) != 1) {
+            state.store(0, std::memory_order_release);
+            futexWake(&state, 1);
+        }
+    }
+#else
+    std::mutex mutex;
+
+    void lock() {
+        if (mutex.try_lock()) { return; }
+
+        contentionCount.fetch_add(1, std::memory_order_relaxed);
+        mutex.lock();
+    }
+
+    void unlock() { mutex.unlock(); }
+#endif
+
+    void lock_shared() { lock(); }
+    void unlock_shared() { unlock(); }
+    uint64_t contentions() const { return contentionCount.load(std::memory_order_relaxed); }
+};
+
+struct BackoffSpinLockPolicy {
+    using Lock = BackoffSpinLock;
+    using UniqueLockGuard = std::unique_lock<Lock>;
+    using SharedLockGuard = std::shared_lock<Lock>;
+};
+
+struct SharedSpinLockPolicy {
+    using Lock = SharedSpinLock;
+    using UniqueLockGuard = std::unique_lock<Lock>;
+    using SharedLockGuard = std::shared_lock<Lock>;
+};
+
+struct FutexLockPolicy {
+    using Lock = FutexLock;
+    using UniqueLockGuard = std::unique_lock<Lock>;
+    using SharedLockGuard = std::shared_lock<Lock>;
+};
+
 struct DefaultExceptionPolicy {
     static constexpr bool NoexceptFree = false;
 
@@ -62,6 +273,53 @@ struct DefaultExceptionPolicy {
         throw E(std::forward<Args>(args)...);
     }
 };
+
+//
+// Instrumentation policies observe the hot paths. With enabled == false no hook is compiled in.
+// An enabled policy provides sample() (whether to time this call), now() (nanoseconds), onLockWait(ns),
+// onAllocLatency(ns), onFreeLatency(ns), onAlloc(size, succeeded, probes) and onFree(size), where probes
+// is the number of free ranges the fit policy examined. Hooks may run concurrently.
+// See TinyFixedInstrumentation.hh for a histogram policy.
+//
+
+struct NoInstrumentationPolicy {
+    static constexpr bool enabled = false;
+};
+}
+
+namespace detail {
+
+inline uint32_t findLastSet(uint64_t value) {
+    assert(value != 0);
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanReverse64(&index, value);
+    return static_cast<uint32_t>(index);
+#else
+    return 63u - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+}
+
+inline uint32_t findFirstSet(uint64_t value) {
+    assert(value != 0);
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward64(&index, value);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+}
+
+inline uint32_t popCount(uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<uint32_t>(__popcnt64(value));
+#elif defined(_MSC_VER)
+    return static_cast<uint32_t>(__popcnt(static_cast<uint32_t>(value)) + __popcnt(static_cast<uint32_t>(value >> 32)));
+#else
+    return static_cast<uint32_t>(__builtin_popcountll(value));
+#endif
+}
 }
 
 template <typename SizeType>
@@ -71,267 +329,2397 @@ struct FixedAllocatorRange {
     size_type size = 0;
 };
 
-template <typename SizeType,
-          typename ContainerType,
-          typename RangeVectorType = std::vector<FixedAllocatorRange<SizeType>>,
-          typename ExceptionPolicy = defaults::DefaultExceptionPolicy,
-          typename LockPolicy = defaults::DefaultSingleThreadedLockPolicy>
-struct FixedAllocator {
+//
+// Allocation request passed to range stores.
+// The allocated range starts `padding()` bytes into the chosen free range, so that the payload address
+// (alignBase + offset) is aligned. The padding stays in the free list.
+// Free ranges are never left smaller than minFragment: the padding is grown by whole alignment steps,
+// and a smaller tail is absorbed into the allocated range.
+//
+
+template <typename SizeType>
+struct FixedAllocatorRequest {
     using size_type = SizeType;
     using range_type = FixedAllocatorRange<SizeType>;
-    static constexpr size_type headerSize = static_cast<size_type>(sizeof(size_type));
-
-    const ContainerType container{};
-    RangeVectorType freeBufferRanges{};
-    mutable typename LockPolicy::Lock lock{};
 
-    explicit FixedAllocator(const ContainerType& c) : container(c) { init(); }
-    explicit FixedAllocator(ContainerType&& c) : container(std::move(c)) { init(); }
+    size_type size = 0;
+    size_type alignment = 1;
+    size_type minFragment = 1;
+    uintptr_t alignBase = 0;
+    mutable size_t probes = 0;
 
-    void init() {
-        assert(container.size() < std::numeric_limits<size_type>::max());
-        freeBufferRanges.clear();
-        freeBufferRanges.push_back({0, static_cast<size_type>(container.size())});
+    size_type padding(size_type offset) const {
+        size_type p = static_cast<size_type>((alignment - ((alignBase + offset) & (alignment - 1))) & (alignment - 1));
+        if (p && p < minFragment) { p += static_cast<size_type>((minFragment - p + alignment - 1) / alignment * alignment); }
+        return p;
     }
 
-    defaults::ByteSpan allocByteSpan(size_type size) {
-        if (container.empty()) { return {}; }
+    uint64_t maxPadding() const {
+        return alignment > 1 ? uint64_t(alignment) - 1 + (minFragment > 1 ? minFragment : 0) : 0;
+    }
 
-        typename LockPolicy::UniqueLockGuard lockGuard(lock);
-        if (freeBufferRanges.empty()) { return {}; }
+    bool fits(const range_type& r) const {
+        ++probes;
+        size_type p = padding(r.offset);
+        return r.size >= p && r.size - p >= size;
+    }
+};
 
-        size_type chunkSize = size + headerSize;
+//
+// Fit policies decide which free range serves an allocation.
+// Each policy provides an Index that range stores notify whenever a free range is inserted or erased, and that picks
+// a range for a request from an offset-ordered store (see FixedAllocatorRangeVector and FixedAllocatorRangeTree).
+//
 
-        auto rangeIt = freeBufferRanges.begin();
-        for (; rangeIt != freeBufferRanges.end(); ++rangeIt) {
-            auto& r = *rangeIt;
+namespace defaults {
 
-            if (r.size >= chunkSize) {
-                uint8_t* headerPtr = container.data() + r.offset;
-                *reinterpret_cast<size_type*>(headerPtr) = chunkSize;
-                
-                uint8_t* allocPtr = headerPtr + headerSize;
-                defaults::ByteSpan occupiedSpan(allocPtr, size);
+struct FirstFitPolicy {
+    template <typename SizeType>
+    struct Index {
+        using range_type = FixedAllocatorRange<SizeType>;
 
-                r.offset += chunkSize;
-                r.size -= chunkSize;
+        void clear() {}
+        void insert(const range_type&) {}
+        void erase(const range_type&) {}
+        void onAlloc(const range_type&) {}
 
-                if (r.size == 0) { freeBufferRanges.erase(rangeIt); }
-                return occupiedSpan;
+        template <typename Store>
+        typename Store::iterator select(Store& store, const FixedAllocatorRequest<SizeType>& request) {
+            auto rangeIt = store.begin();
+            for (; rangeIt != store.end(); ++rangeIt) {
+                if (request.fits(Store::rangeOf(rangeIt))) { break; }
             }
+
+            return rangeIt;
         }
+    };
+};
 
-        return {};
-    }
+//
+// First-fit that starts searching where the previous allocation ended, and wraps around.
+//
 
-    void* alloc(size_type size) {
-        auto allocatedSpan = allocByteSpan(size);
-        return allocatedSpan.data();
-    }
+struct NextFitPolicy {
+    template <typename SizeType>
+    struct Index {
+        using range_type = FixedAllocatorRange<SizeType>;
 
-    bool freeRange(range_type rr) noexcept(ExceptionPolicy::NoexceptFree) {
-        typename LockPolicy::UniqueLockGuard lockGuard(lock);
+        SizeType cursor = 0;
 
-        //
-        // Special fast-exit case, when we can simply add a new free range and succeed.
-        //
-        
-        if (freeBufferRanges.empty()) {
-            freeBufferRanges.push_back(rr);
-            return true;
+        void clear() { cursor = 0; }
+        void insert(const range_type&) {}
+        void erase(const range_type&) {}
+        void onAlloc(const range_type& r) { cursor = r.offset + r.size; }
+
+        template <typename Store>
+        typename Store::iterator select(Store& store, const FixedAllocatorRequest<SizeType>& request) {
+            auto startIt = store.lowerBound(cursor);
+
+            auto rangeIt = startIt;
+            for (; rangeIt != store.end(); ++rangeIt) {
+                if (request.fits(Store::rangeOf(rangeIt))) { return rangeIt; }
+            }
+
+            rangeIt = store.begin();
+            for (; rangeIt != startIt; ++rangeIt) {
+                if (request.fits(Store::rangeOf(rangeIt))) { return rangeIt; }
+            }
+
+            return store.end();
         }
+    };
+};
 
-        size_type rrEnd = rr.offset + rr.size;
+//
+// Smallest (best-fit) or largest (worst-fit) range, looked up in a size-ordered secondary index.
+// Ties are broken by the lowest offset. Aligned requests walk the index past ranges too small for their padding,
+// any range of at least size + alignment - 1 bytes fits.
+//
 
-        auto rangeIt = freeBufferRanges.begin();
-        for (; rangeIt != freeBufferRanges.end(); ++rangeIt) {
-            auto& r = *rangeIt;
-            
-            //
-            // Extend the right free range from the left side.
-            // Maybe merge with the previous block.
-            //
-            
-            if (rrEnd == r.offset) {
-                r.offset = rr.offset;
-                r.size += rr.size;
-                
-                if (rangeIt != freeBufferRanges.begin()) {
-                    auto prevRangeIt = rangeIt - 1;
-                    if (prevRangeIt != freeBufferRanges.end()) {
-                        auto& pr = *prevRangeIt;
-                        auto prEnd = pr.offset + pr.size;
-                        if (prEnd == r.offset) {
-                            pr.size += r.size;
-                            freeBufferRanges.erase(rangeIt);
-                        }
-                    }
+template <bool Best>
+struct SizeOrderedFitPolicy {
+    template <typename SizeType>
+    struct Index {
+        using range_type = FixedAllocatorRange<SizeType>;
+
+        std::set<std::pair<SizeType, SizeType>> rangesBySize{};
+
+        void clear() { rangesBySize.clear(); }
+        void insert(const range_type& r) { rangesBySize.emplace(r.size, r.offset); }
+        void erase(const range_type& r) { rangesBySize.erase({r.size, r.offset}); }
+        void onAlloc(const range_type&) {}
+
+        template <typename Store>
+        typename Store::iterator select(Store& store, const FixedAllocatorRequest<SizeType>& request) {
+            if (rangesBySize.empty()) { return store.end(); }
+
+            if (Best) {
+                auto sizeIt = rangesBySize.lower_bound({request.size, SizeType(0)});
+                for (; sizeIt != rangesBySize.end(); ++sizeIt) {
+                    if (request.fits({sizeIt->second, sizeIt->first})) { return store.find(sizeIt->second); }
                 }
-                
-                return true;
+
+                return store.end();
             }
-            
+
             //
-            // Extend the left free range from the right side.
-            // Maybe merge with the next block.
+            // Walk groups of equally sized ranges from the largest down, lowest offset first within a group.
             //
 
-            auto rEnd = r.offset + r.size;
-            if (rEnd == rr.offset) {
-                r.size += rr.size;
-                rEnd = r.offset + r.size;
+            auto groupEndIt = rangesBySize.end();
+            while (groupEndIt != rangesBySize.begin()) {
+                auto sizeIt = rangesBySize.lower_bound({std::prev(groupEndIt)->first, SizeType(0)});
+                if (sizeIt->first < request.size) { break; }
 
-                auto nextRangeIt = rangeIt + 1;
-                if (nextRangeIt != freeBufferRanges.end()) {
-                    auto& nr = *nextRangeIt;
-                    if (nr.offset == rEnd) {
-                        r.size += nr.size;
-                        freeBufferRanges.erase(nextRangeIt);
-                    }
+                auto groupBeginIt = sizeIt;
+                for (; sizeIt != groupEndIt; ++sizeIt) {
+                    if (request.fits({sizeIt->second, sizeIt->first})) { return store.find(sizeIt->second); }
                 }
 
-                return true;
+                groupEndIt = groupBeginIt;
             }
+
+            return store.end();
         }
-        
-        //
-        // Insert the new range.
-        //
+    };
+};
 
-        rangeIt = freeBufferRanges.begin();
-        auto prevRangeIt = freeBufferRanges.end();
-        for (; rangeIt != freeBufferRanges.end(); prevRangeIt = rangeIt++) {
-            auto& r = *rangeIt;
+using BestFitPolicy = SizeOrderedFitPolicy<true>;
+using WorstFitPolicy = SizeOrderedFitPolicy<false>;
+}
 
-            if (r.offset > rr.offset) {
-                if (prevRangeIt == freeBufferRanges.end()) {
-                    freeBufferRanges.insert(rangeIt, rr);
-                    return true;
-                }
+//
+// Block formats define what the allocator writes around each block.
+// SizeHeaderBlockFormat writes the chunk size right before the payload.
+// BoundaryTagBlockFormat writes a size tag with a free flag (the top bit) at both ends of every block, free ranges
+// included, so free() finds out whether the physical neighbours are free without searching the free list
+// and catches double frees from the block's own tag.
+// HeaderlessBlockFormat writes nothing: blocks are released with free(ptr, size), the caller passes the size it
+// allocated. With CheckSizes (on in debug builds by default) the allocator also keeps the sizes out of band
+// and catches mismatched sizes and double frees.
+//
 
-                auto& pr = *prevRangeIt;
-                auto prEnd = pr.offset + pr.size;
+namespace defaults {
 
-                if (prEnd < rr.offset && r.offset > rrEnd) {
-                    freeBufferRanges.insert(rangeIt, rr);
-                    return true;
-                }
-            }
-        }
-        
-        //
-        // Check for double-free error.
-        //
-            
-        rangeIt = freeBufferRanges.begin();
-        for (; rangeIt != freeBufferRanges.end(); ++rangeIt) {
-            auto& r = *rangeIt;
-            auto rEnd = r.offset + r.size;
-            
-            if (r.offset <= rr.offset && rEnd > rr.offset) {
-                return false;
-            }
-            
-            if (r.offset <= rrEnd && rEnd > rrEnd) {
-                return false;
-            }
+struct SizeHeaderBlockFormat {
+    template <typename SizeType>
+    struct Layout {
+        using range_type = FixedAllocatorRange<SizeType>;
+
+        static constexpr bool boundaryTags = false;
+        static constexpr bool headerless = false;
+        static constexpr bool checkSizes = false;
+        static constexpr SizeType headerSize = static_cast<SizeType>(sizeof(SizeType));
+        static constexpr SizeType trailerSize = 0;
+        static constexpr SizeType minFragmentSize = 1;
+
+        static SizeType chunkSize(const uint8_t* headerPtr) { return *reinterpret_cast<const SizeType*>(headerPtr); }
+        static void writeUsed(uint8_t* base, const range_type& r) { *reinterpret_cast<SizeType*>(base + r.offset) = r.size; }
+        static void writeFree(uint8_t*, const range_type&) {}
+    };
+};
+
+struct BoundaryTagBlockFormat {
+    template <typename SizeType>
+    struct Layout {
+        using range_type = FixedAllocatorRange<SizeType>;
+
+        static constexpr bool boundaryTags = true;
+        static constexpr bool headerless = false;
+        static constexpr bool checkSizes = false;
+        static constexpr SizeType freeBit = static_cast<SizeType>(SizeType(1) << (sizeof(SizeType) * 8 - 1));
+        static constexpr SizeType headerSize = static_cast<SizeType>(sizeof(SizeType));
+        static constexpr SizeType trailerSize = static_cast<SizeType>(sizeof(SizeType));
+        static constexpr SizeType minFragmentSize = headerSize + trailerSize;
+
+        static SizeType tag(const uint8_t* tagPtr) { return *reinterpret_cast<const SizeType*>(tagPtr); }
+        static SizeType chunkSize(const uint8_t* tagPtr) { return static_cast<SizeType>(tag(tagPtr) & ~freeBit); }
+        static bool isFree(const uint8_t* tagPtr) { return (tag(tagPtr) & freeBit) != 0; }
+
+        static void writeTags(uint8_t* base, const range_type& r, SizeType flags) {
+            *reinterpret_cast<SizeType*>(base + r.offset) = r.size | flags;
+            *reinterpret_cast<SizeType*>(base + r.offset + r.size - trailerSize) = r.size | flags;
         }
-        
-        //
-        // Append the new range.
-        //
 
-        freeBufferRanges.push_back(rr);
-        return true;
+        static void writeUsed(uint8_t* base, const range_type& r) { writeTags(base, r, 0); }
+        static void writeFree(uint8_t* base, const range_type& r) { writeTags(base, r, freeBit); }
+    };
+};
+
+#if defined(_DEBUG)
+constexpr bool checkHeaderlessSizes = true;
+#else
+constexpr bool checkHeaderlessSizes = false;
+#endif
+
+template <bool CheckSizes = checkHeaderlessSizes>
+struct HeaderlessBlockFormat {
+    template <typename SizeType>
+    struct Layout {
+        using range_type = FixedAllocatorRange<SizeType>;
+
+        static constexpr bool boundaryTags = false;
+        static constexpr bool headerless = true;
+        static constexpr bool checkSizes = CheckSizes;
+        static constexpr SizeType headerSize = 0;
+        static constexpr SizeType trailerSize = 0;
+        static constexpr SizeType minFragmentSize = 1;
+
+        static void writeUsed(uint8_t*, const range_type&) {}
+        static void writeFree(uint8_t*, const range_type&) {}
+    };
+};
+}
+
+//
+// Snapshot of the running counters of a FixedAllocator.
+// The largest free block is exact as long as the largest range is not erased without a larger or equal one being
+// inserted, otherwise it falls back to its size class (eight classes per power of two, at most 1/8 below the real
+// size). It is never above the real size, so it is always safe to test a request against.
+//
+
+struct FixedAllocatorStats {
+    size_t capacity = 0;
+    size_t freeBytes = 0;
+    size_t occupiedBytes = 0;
+    size_t liveAllocations = 0;
+    size_t freeRangeCount = 0;
+    size_t highWaterMark = 0;
+    size_t largestFreeBlock = 0;
+
+    //
+    // External fragmentation, 0 when all free space is one block, close to 1 when it is scattered.
+    //
+
+    double fragmentation() const {
+        return freeBytes ? 1.0 - double(largestFreeBlock) / double(freeBytes) : 0.0;
     }
+};
 
-    void free(void* dataPtr) noexcept(ExceptionPolicy::NoexceptFree) {
-        if (!dataPtr || container.empty()) { return; }
-        
-        auto c = container.data();
-        auto cEnd = c + container.size();
+namespace detail {
 
-        if (dataPtr < c || dataPtr >= cEnd) {
-            ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is out of bounds.");
-        }
-        
-        uintptr_t allocAddress = reinterpret_cast<uintptr_t>(dataPtr);
-        uintptr_t containerDataAddress = reinterpret_cast<uintptr_t>(container.data());
-        uintptr_t offset = allocAddress - containerDataAddress;
-        
-        if (offset < headerSize) { assert(false); return; }
-        offset -= headerSize;
-        
-        uint8_t* headerPtr = reinterpret_cast<uint8_t*>(dataPtr) - headerSize;
-        
-        range_type r = {};
-        r.offset = static_cast<size_type>(offset);
-        r.size = static_cast<size_type>(*reinterpret_cast<size_type*>(headerPtr));
+//
+// Running counters of a FixedAllocator, written under the allocator lock and read without it.
+// Free ranges are also counted per size class. Inserts keep the largest free block exact, erasing it falls back
+// to the lower bound of the highest non-empty class, both in O(1).
+//
 
-        if (!r.size || !freeRange(r)) {
-            ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is already free.");
+struct FixedAllocatorCounters {
+    static constexpr uint32_t subClassLog2 = 3;
+    static constexpr uint32_t subClassCount = 1u << subClassLog2;
+    static constexpr uint32_t classCount = 64;
+
+    std::atomic<size_t> freeBytes{0};
+    std::atomic<size_t> freeRangeCount{0};
+    std::atomic<size_t> liveAllocations{0};
+    std::atomic<size_t> highWaterMark{0};
+    std::atomic<size_t> largestFreeBlock{0};
+
+    size_t classCounts[classCount][subClassCount] = {};
+    uint32_t subClassBitmaps[classCount] = {};
+    uint64_t classBitmap = 0;
+
+    static void mapClass(uint64_t size, uint32_t& c, uint32_t& sc) {
+        if (size < subClassCount) {
+            c = 0;
+            sc = static_cast<uint32_t>(size);
+            return;
         }
+
+        uint32_t msb = findLastSet(size);
+        c = msb - subClassLog2 + 1;
+        sc = static_cast<uint32_t>(size >> (msb - subClassLog2)) ^ subClassCount;
     }
 
-    size_type totalOccupiedSpace() const {
-        return container.size() - totalFreeSpace();
+    static uint64_t classSize(uint32_t c, uint32_t sc) {
+        return c ? uint64_t(subClassCount | sc) << (c - 1) : sc;
     }
 
-    size_type totalFreeSpace() const {
-        typename LockPolicy::SharedLockGuard lockGuard(lock);
+    void clear() {
+        freeBytes.store(0, std::memory_order_relaxed);
+        freeRangeCount.store(0, std::memory_order_relaxed);
+        liveAllocations.store(0, std::memory_order_relaxed);
+        highWaterMark.store(0, std::memory_order_relaxed);
+        largestFreeBlock.store(0, std::memory_order_relaxed);
 
-        size_type totalFreeSize = 0;
-        auto rangeIt = freeBufferRanges.begin();
-        for (; rangeIt != freeBufferRanges.end(); ++rangeIt) {
-            auto& r = *rangeIt;
-            totalFreeSize += r.size;
+        for (auto& counts : classCounts) { std::fill(std::begin(counts), std::end(counts), size_t(0)); }
+        std::fill(std::begin(subClassBitmaps), std::end(subClassBitmaps), 0u);
+        classBitmap = 0;
+    }
+
+    void insertFree(uint64_t size) {
+        uint32_t c = 0, sc = 0;
+        mapClass(size, c, sc);
+        if (!classCounts[c][sc]++) {
+            subClassBitmaps[c] |= 1u << sc;
+            classBitmap |= uint64_t(1) << c;
         }
 
-        return totalFreeSize;
+        freeBytes.store(freeBytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+        freeRangeCount.store(freeRangeCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (size > largestFreeBlock.load(std::memory_order_relaxed)) { largestFreeBlock.store(static_cast<size_t>(size), std::memory_order_relaxed); }
     }
 
-    void dumpState(std::ostream& out = std::cout) const {
-        typename LockPolicy::SharedLockGuard lockGuard(lock);
-        
-        out << ">>> ----------" << std::endl;
-        out << __FUNCTION__ << ":" << std::endl;
-        out << "wholeBuffer={ptr=" << (void*)(container.data()) << ", size=" << container.size() << "}" << std::endl;
-        out << "FreeRanges=[";
-        
-        size_type totalFreeSize = 0;
-        auto rangeIt = freeBufferRanges.begin();
-        for (; rangeIt != freeBufferRanges.end(); ++rangeIt) {
-            auto& r = *rangeIt;
-            totalFreeSize += r.size;
-            out << "{offset=" << r.offset << ",size=" << r.size << "},";
+    void eraseFree(uint64_t size) {
+        uint32_t c = 0, sc = 0;
+        mapClass(size, c, sc);
+        assert(classCounts[c][sc] > 0);
+        if (!--classCounts[c][sc]) {
+            subClassBitmaps[c] &= ~(1u << sc);
+            if (!subClassBitmaps[c]) { classBitmap &= ~(uint64_t(1) << c); }
         }
-        
-        out << "]" << std::endl;
+
+        freeBytes.store(freeBytes.load(std::memory_order_relaxed) - size, std::memory_order_relaxed);
+        freeRangeCount.store(freeRangeCount.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        if (size >= largestFreeBlock.load(std::memory_order_relaxed)) { publishLargest(); }
+    }
+
+    void publishLargest() {
+        uint64_t largest = 0;
+        if (classBitmap) {
+            uint32_t c = findLastSet(classBitmap);
+            largest = classSize(c, findLastSet(subClassBitmaps[c]));
+        }
+
+        largestFreeBlock.store(static_cast<size_t>(largest), std::memory_order_relaxed);
+    }
+
+    void addAllocations(size_t count, size_t capacity) {
+        liveAllocations.store(liveAllocations.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        updateHighWaterMark(capacity);
+    }
+
+    void removeAllocations(size_t count) {
+        liveAllocations.store(liveAllocations.load(std::memory_order_relaxed) - count, std::memory_order_relaxed);
+    }
+
+    void updateHighWaterMark(size_t capacity) {
+        size_t occupied = capacity - freeBytes.load(std::memory_order_relaxed);
+        if (occupied > highWaterMark.load(std::memory_order_relaxed)) { highWaterMark.store(occupied, std::memory_order_relaxed); }
+    }
+};
+
+//
+// Times one sampled alloc or free call: the wait for the lock and the whole call.
+//
+
+template <typename InstrumentationPolicy, bool Enabled = InstrumentationPolicy::enabled>
+struct FixedAllocatorSample {
+    explicit FixedAllocatorSample(InstrumentationPolicy&) {}
+    void lockAcquired() {}
+    void allocDone() {}
+    void freeDone() {}
+};
+
+template <typename InstrumentationPolicy>
+struct FixedAllocatorSample<InstrumentationPolicy, true> {
+    InstrumentationPolicy& instrumentation;
+    bool sampled = false;
+    uint64_t startTime = 0;
+
+    explicit FixedAllocatorSample(InstrumentationPolicy& i) : instrumentation(i), sampled(i.sample()) {
+        if (sampled) { startTime = instrumentation.now(); }
+    }
+
+    void lockAcquired() {
+        if (sampled) { instrumentation.onLockWait(instrumentation.now() - startTime); }
+    }
+
+    void allocDone() {
+        if (sampled) { instrumentation.onAllocLatency(instrumentation.now() - startTime); }
+    }
+
+    void freeDone() {
+        if (sampled) { instrumentation.onFreeLatency(instrumentation.now() - startTime); }
+    }
+};
+
+//
+// Out-of-band sizes of live headerless blocks, keyed by offset. Used under the allocator lock.
+//
+
+template <typename SizeType, bool Enabled>
+struct FixedAllocatorSizeRegistry {
+    template <typename Range> void insert(const Range&) {}
+    template <typename Range> bool contains(const Range&) const { return true; }
+    template <typename Range> void erase(const Range&) {}
+    bool matches(size_t) const { return true; }
+};
+
+template <typename SizeType>
+struct FixedAllocatorSizeRegistry<SizeType, true> {
+    std::unordered_map<SizeType, SizeType> sizes{};
+
+    template <typename Range> void insert(const Range& r) { sizes[r.offset] = r.size; }
+    template <typename Range> void erase(const Range& r) { sizes.erase(r.offset); }
+
+    template <typename Range>
+    bool contains(const Range& r) const {
+        auto it = sizes.find(r.offset);
+        return it != sizes.end() && it->second == r.size;
+    }
+
+    bool matches(size_t liveAllocations) const { return sizes.size() == liveAllocations; }
+};
+
+//
+// Forwards range store notifications to the fit index and the counters, and keeps the block format tags
+// of free ranges up to date.
+//
+
+template <typename FitIndex, typename Layout>
+struct FixedAllocatorRangeObserver {
+    using range_type = typename Layout::range_type;
+    using layout_type = Layout;
+
+    FitIndex& fit;
+    FixedAllocatorCounters& counters;
+    uint8_t* base;
+
+    void clear() { fit.clear(); counters.clear(); }
+    void insert(const range_type& r) { fit.insert(r); counters.insertFree(r.size); Layout::writeFree(base, r); }
+    void erase(const range_type& r) { fit.erase(r); counters.eraseFree(r.size); }
+    void onAlloc(const range_type& r) { fit.onAlloc(r); }
+
+    template <typename Store, typename Request>
+    typename Store::iterator select(Store& store, const Request& request) { return fit.select(store, request); }
+};
+
+//
+// Observer of the free paths for containers that return memory to the OS (see VirtualMemoryContainer).
+// Every coalesced free range is reported to the container together with the freed span, so only the pages that
+// just became free are decommitted. Tag bytes at both ends of the free range are left out, and so are the
+// in-band fields a range store keeps next to them (KeepFront bytes after the header, KeepBack before the trailer).
+//
+
+template <typename FitIndex, typename Layout, typename Container, size_t KeepFront = 0, size_t KeepBack = 0>
+struct FixedAllocatorDecommitObserver : FixedAllocatorRangeObserver<FitIndex, Layout> {
+    using range_type = typename Layout::range_type;
+
+    static constexpr size_t keepFront = Layout::headerSize + KeepFront;
+    static constexpr size_t keepBack = Layout::trailerSize + KeepBack;
+
+    const Container& container;
+    range_type freed;
+
+    void insert(const range_type& r) {
+        FixedAllocatorRangeObserver<FitIndex, Layout>::insert(r);
+        if (r.size <= keepFront + keepBack) { return; }
+
+        container.decommitFreeRange(size_t(r.offset) + keepFront,
+                                    size_t(r.size) - keepFront - keepBack,
+                                    size_t(freed.offset),
+                                    size_t(freed.size));
+    }
+};
+}
+
+//
+// Range stores keep the free ranges of a FixedAllocator.
+// A store exposes reset(), assign() (rebuild from the free and used ranges of a container that already holds blocks),
+// allocRange(), freeRange(), freeRangeHinted(), freeRanges() (a batch sorted by offset), expandRange(), shrinkRange()
+// (in-place resizing of a used range), freeRangeBefore() and slideRange() (compaction, with a callback that moves
+// the block bytes), forEachRange() (in offset order), size() and empty(),
+// and marks itself with `isRangeStore`. Any other type passed as RangeVectorType is treated as a vector of ranges
+// and wrapped into FixedAllocatorRangeVector, which is the original sorted list.
+// Offset-ordered stores additionally expose begin(), end(), rangeOf(), lowerBound() and find() for fit policies.
+//
+
+template <typename SizeType, typename RangeVectorType = std::vector<FixedAllocatorRange<SizeType>>>
+struct FixedAllocatorRangeVector {
+    static constexpr bool isRangeStore = true;
+
+    using size_type = SizeType;
+    using range_type = FixedAllocatorRange<SizeType>;
+    using request_type = FixedAllocatorRequest<SizeType>;
+    using iterator = typename RangeVectorType::iterator;
+
+    RangeVectorType ranges{};
+
+    template <typename FitIndex>
+    void reset(size_type size, FitIndex& fit) {
+        ranges.clear();
+        fit.clear();
+
+        ranges.push_back({0, size});
+        fit.insert(ranges.back());
+    }
+
+    //
+    // Both lists are sorted by offset, free ranges are coalesced.
+    //
+
+    template <typename FitIndex>
+    bool assign(const range_type* freeRanges, size_t freeCount, const range_type*, size_t, FitIndex& fit) {
+        ranges.clear();
+        fit.clear();
+
+        for (size_t i = 0; i < freeCount; ++i) {
+            ranges.push_back(freeRanges[i]);
+            fit.insert(freeRanges[i]);
+        }
+
+        return true;
+    }
+
+    size_t size() const { return ranges.size(); }
+    bool empty() const { return ranges.empty(); }
+
+    template <typename Fn>
+    void forEachRange(Fn&& fn) const {
+        auto rangeIt = ranges.begin();
+        for (; rangeIt != ranges.end(); ++rangeIt) { fn(*rangeIt); }
+    }
+
+    iterator begin() { return ranges.begin(); }
+    iterator end() { return ranges.end(); }
+    static range_type rangeOf(iterator rangeIt) { return *rangeIt; }
+
+    iterator lowerBound(size_type offset) {
+        return std::lower_bound(ranges.begin(), ranges.end(), offset, [](const range_type& r, size_type o) {
+            return r.offset < o;
+        });
+    }
+
+    iterator find(size_type offset) {
+        auto rangeIt = lowerBound(offset);
+        return (rangeIt != ranges.end() && rangeIt->offset == offset) ? rangeIt : ranges.end();
+    }
+
+    template <typename FitIndex>
+    bool allocRange(const request_type& request, FitIndex& fit, range_type& allocatedRange) {
+        auto rangeIt = fit.select(*this, request);
+        if (rangeIt == ranges.end()) { return false; }
+
+        auto& r = *rangeIt;
+        size_type padding = request.padding(r.offset);
+        allocatedRange = {static_cast<size_type>(r.offset + padding), request.size};
+
+        range_type tail = {};
+        tail.offset = static_cast<size_type>(allocatedRange.offset + request.size);
+        tail.size = static_cast<size_type>(r.size - padding - request.size);
+        if (tail.size < request.minFragment) {
+            allocatedRange.size += tail.size;
+            tail.size = 0;
+        }
+
+        fit.erase(r);
+
+        //
+        // The padding stays in place as a free range, the tail goes right after it.
+        //
+
+        if (padding) {
+            r.size = padding;
+            fit.insert(r);
+
+            if (tail.size) {
+                ranges.insert(rangeIt + 1, tail);
+                fit.insert(tail);
+            }
+        } else if (tail.size) {
+            r = tail;
+            fit.insert(r);
+        } else {
+            ranges.erase(rangeIt);
+        }
+
+        fit.onAlloc(allocatedRange);
+        return true;
+    }
+
+    template <typename FitIndex>
+    bool freeRange(range_type rr, FitIndex& fit) {
+
+        //
+        // Special fast-exit case, when we can simply add a new free range and succeed.
+        //
+
+        if (ranges.empty()) {
+            ranges.push_back(rr);
+            fit.insert(rr);
+            return true;
+        }
+
+        size_type rrEnd = rr.offset + rr.size;
+
+        auto rangeIt = ranges.begin();
+        for (; rangeIt != ranges.end(); ++rangeIt) {
+            auto& r = *rangeIt;
+
+            //
+            // Extend the right free range from the left side.
+            // Maybe merge with the previous block.
+            //
+
+            if (rrEnd == r.offset) {
+                fit.erase(r);
+                r.offset = rr.offset;
+                r.size += rr.size;
+
+                if (rangeIt != ranges.begin()) {
+                    auto prevRangeIt = rangeIt - 1;
+                    if (prevRangeIt != ranges.end()) {
+                        auto& pr = *prevRangeIt;
+                        auto prEnd = pr.offset + pr.size;
+                        if (prEnd == r.offset) {
+                            fit.erase(pr);
+                            pr.size += r.size;
+                            fit.insert(pr);
+                            ranges.erase(rangeIt);
+                            return true;
+                        }
+                    }
+                }
+
+                fit.insert(r);
+                return true;
+            }
+
+            //
+            // Extend the left free range from the right side.
+            // Maybe merge with the next block.
+            //
+
+            auto rEnd = r.offset + r.size;
+            if (rEnd == rr.offset) {
+                fit.erase(r);
+                r.size += rr.size;
+                rEnd = r.offset + r.size;
+
+                auto nextRangeIt = rangeIt + 1;
+                if (nextRangeIt != ranges.end()) {
+                    auto& nr = *nextRangeIt;
+                    if (nr.offset == rEnd) {
+                        fit.erase(nr);
+                        r.size += nr.size;
+                        ranges.erase(nextRangeIt);
+                    }
+                }
+
+                fit.insert(r);
+                return true;
+            }
+        }
+
+        //
+        // Insert the new range.
+        //
+
+        rangeIt = ranges.begin();
+        auto prevRangeIt = ranges.end();
+        for (; rangeIt != ranges.end(); prevRangeIt = rangeIt++) {
+            auto& r = *rangeIt;
+
+            if (r.offset > rr.offset) {
+                if (prevRangeIt == ranges.end()) {
+                    ranges.insert(rangeIt, rr);
+                    fit.insert(rr);
+                    return true;
+                }
+
+                auto& pr = *prevRangeIt;
+                auto prEnd = pr.offset + pr.size;
+
+                if (prEnd < rr.offset && r.offset > rrEnd) {
+                    ranges.insert(rangeIt, rr);
+                    fit.insert(rr);
+                    return true;
+                }
+            }
+        }
+
+        //
+        // Check for double-free error.
+        //
+
+        rangeIt = ranges.begin();
+        for (; rangeIt != ranges.end(); ++rangeIt) {
+            auto& r = *rangeIt;
+            auto rEnd = r.offset + r.size;
+
+            if (r.offset <= rr.offset && rEnd > rr.offset) {
+                return false;
+            }
+
+            if (r.offset <= rrEnd && rEnd > rrEnd) {
+                return false;
+            }
+        }
+
+        //
+        // Append the new range.
+        //
+
+        ranges.push_back(rr);
+        fit.insert(rr);
+        return true;
+    }
+
+    //
+    // Free with the state of the physical neighbours already known (boundary tags).
+    // One binary search finds the position, no list scans and no overlap passes.
+    //
+
+    template <typename FitIndex>
+    bool freeRangeHinted(range_type rr, bool prevIsFree, bool nextIsFree, FitIndex& fit) {
+        size_type rrEnd = rr.offset + rr.size;
+
+        auto nextRangeIt = lowerBound(rr.offset);
+        auto prevRangeIt = nextRangeIt != ranges.begin() ? nextRangeIt - 1 : ranges.end();
+
+        bool hasPrev = prevRangeIt != ranges.end();
+        bool hasNext = nextRangeIt != ranges.end();
+        if (hasPrev && prevRangeIt->offset + prevRangeIt->size > rr.offset) { return false; }
+        if (hasNext && nextRangeIt->offset < rrEnd) { return false; }
+        if (prevIsFree != (hasPrev && prevRangeIt->offset + prevRangeIt->size == rr.offset)) { return false; }
+        if (nextIsFree != (hasNext && nextRangeIt->offset == rrEnd)) { return false; }
+
+        if (prevIsFree && nextIsFree) {
+            fit.erase(*prevRangeIt);
+            fit.erase(*nextRangeIt);
+            prevRangeIt->size += rr.size + nextRangeIt->size;
+            fit.insert(*prevRangeIt);
+            ranges.erase(nextRangeIt);
+        } else if (prevIsFree) {
+            fit.erase(*prevRangeIt);
+            prevRangeIt->size += rr.size;
+            fit.insert(*prevRangeIt);
+        } else if (nextIsFree) {
+            fit.erase(*nextRangeIt);
+            nextRangeIt->offset = rr.offset;
+            nextRangeIt->size += rr.size;
+            fit.insert(*nextRangeIt);
+        } else {
+            ranges.insert(nextRangeIt, rr);
+            fit.insert(rr);
+        }
+
+        return true;
+    }
+
+    //
+    // Grows the block into the free range that starts right at its end, a remainder below minFragment is taken
+    // as well. Shrinking gives the tail back to that free range, or makes it a new one.
+    //
+
+    template <typename FitIndex>
+    bool expandRange(range_type& block, size_type newSize, size_type minFragment, FitIndex& fit) {
+        size_type blockEnd = block.offset + block.size;
+        auto nextRangeIt = lowerBound(blockEnd);
+        if (nextRangeIt == ranges.end() || nextRangeIt->offset != blockEnd) { return false; }
+        if (uint64_t(block.size) + nextRangeIt->size < newSize) { return false; }
+
+        size_type taken = newSize - block.size;
+        fit.erase(*nextRangeIt);
+
+        if (nextRangeIt->size - taken < minFragment) {
+            block.size += nextRangeIt->size;
+            ranges.erase(nextRangeIt);
+            return true;
+        }
+
+        nextRangeIt->offset += taken;
+        nextRangeIt->size -= taken;
+        fit.insert(*nextRangeIt);
+        block.size = newSize;
+        return true;
+    }
+
+    template <typename FitIndex>
+    bool shrinkRange(range_type& block, size_type newSize, size_type minFragment, FitIndex& fit) {
+        size_type tail = block.size - newSize;
+        size_type blockEnd = block.offset + block.size;
+        auto nextRangeIt = lowerBound(blockEnd);
+
+        if (nextRangeIt != ranges.end() && nextRangeIt->offset == blockEnd) {
+            fit.erase(*nextRangeIt);
+            nextRangeIt->offset -= tail;
+            nextRangeIt->size += tail;
+            fit.insert(*nextRangeIt);
+        } else if (tail >= minFragment) {
+            range_type r = {static_cast<size_type>(blockEnd - tail), tail};
+            ranges.insert(nextRangeIt, r);
+            fit.insert(r);
+        } else {
+            return false;
+        }
+
+        block.size = newSize;
+        return true;
+    }
+
+    //
+    // Sliding moves a used block down to the start of the free range that ends where the block starts.
+    // The free range moves up by the block size and merges with the free range after the block.
+    // moveBytes() moves the block bytes before the new free range tags are written over the old location.
+    //
+
+    bool freeRangeBefore(size_type offset, range_type& r) {
+        auto rangeIt = lowerBound(offset);
+        if (rangeIt == ranges.begin()) { return false; }
+
+        --rangeIt;
+        if (rangeIt->offset + rangeIt->size != offset) { return false; }
+
+        r = *rangeIt;
+        return true;
+    }
+
+    template <typename FitIndex, typename MoveFn>
+    bool slideRange(range_type& block, FitIndex& fit, MoveFn&& moveBytes) {
+        auto nextRangeIt = lowerBound(block.offset);
+        if (nextRangeIt == ranges.begin()) { return false; }
+
+        auto prevRangeIt = nextRangeIt - 1;
+        if (prevRangeIt->offset + prevRangeIt->size != block.offset) { return false; }
+
+        moveBytes();
+
+        size_type blockEnd = block.offset + block.size;
+        fit.erase(*prevRangeIt);
+        block.offset = prevRangeIt->offset;
+        prevRangeIt->offset = block.offset + block.size;
+
+        if (nextRangeIt != ranges.end() && nextRangeIt->offset == blockEnd) {
+            fit.erase(*nextRangeIt);
+            prevRangeIt->size += nextRangeIt->size;
+            ranges.erase(nextRangeIt);
+        }
+
+        fit.insert(*prevRangeIt);
+        return true;
+    }
+
+    //
+    // Frees a batch of ranges sorted by offset in one linear merge with the free list.
+    // Nothing is freed if any of the ranges overlaps a free range or another range of the batch.
+    //
+
+    template <typename FitIndex>
+    bool freeRanges(const range_type* sortedRanges, size_t count, FitIndex& fit) {
+        if (!count) { return true; }
+
+        size_t i = 0, j = 0;
+        uint64_t prevEnd = 0;
+        while (i < ranges.size() || j < count) {
+            bool takeFreed = i == ranges.size() || (j < count && sortedRanges[j].offset < ranges[i].offset);
+            const range_type& r = takeFreed ? sortedRanges[j++] : ranges[i++];
+            if (r.offset < prevEnd) { return false; }
+            prevEnd = uint64_t(r.offset) + r.size;
+        }
+
+        //
+        // Adjacent ranges are coalesced on the way. Free ranges are never adjacent to each other, so every merge
+        // involves a freed range and only changed ranges are reported to the fit index.
+        // The merged list is a local, so a fixed capacity store does not carry a second range table inline.
+        //
+
+        std::vector<range_type> mergedRanges;
+        mergedRanges.reserve(ranges.size() + count);
+
+        range_type merged = {};
+        bool hasMerged = false;
+        bool mergedChanged = false;
+        size_t absorbedFrom = 0;
+
+        auto flush = [&](size_t absorbedTo) {
+            if (mergedChanged) {
+                for (size_t k = absorbedFrom; k < absorbedTo; ++k) { fit.erase(ranges[k]); }
+                fit.insert(merged);
+            }
+
+            mergedRanges.push_back(merged);
+        };
+
+        i = 0;
+        j = 0;
+        while (i < ranges.size() || j < count) {
+            bool takeFreed = i == ranges.size() || (j < count && sortedRanges[j].offset < ranges[i].offset);
+            const range_type& r = takeFreed ? sortedRanges[j] : ranges[i];
+
+            if (hasMerged && merged.offset + merged.size == r.offset) {
+                merged.size += r.size;
+                mergedChanged = true;
+            } else {
+                if (hasMerged) { flush(i); }
+
+                merged = r;
+                hasMerged = true;
+                mergedChanged = takeFreed;
+                absorbedFrom = i;
+            }
+
+            if (takeFreed) {
+                ++j;
+            } else {
+                ++i;
+            }
+        }
+
+        flush(i);
+        ranges.clear();
+        for (const range_type& r : mergedRanges) { ranges.push_back(r); }
+        return true;
+    }
+};
+
+//
+// Offset-ordered store backed by a balanced tree (offset -> size).
+// Neighbour lookup, coalescing, insertion and double-free detection are logarithmic, and nothing is shifted around.
+//
+
+template <typename SizeType, typename MapType = std::map<SizeType, SizeType>>
+struct FixedAllocatorRangeTree {
+    static constexpr bool isRangeStore = true;
+
+    using size_type = SizeType;
+    using range_type = FixedAllocatorRange<SizeType>;
+    using request_type = FixedAllocatorRequest<SizeType>;
+    using iterator = typename MapType::iterator;
+
+    MapType ranges{};
+
+    template <typename FitIndex>
+    void reset(size_type size, FitIndex& fit) {
+        ranges.clear();
+        fit.clear();
+
+        ranges.emplace(0, size);
+        fit.insert({0, size});
+    }
+
+    template <typename FitIndex>
+    bool assign(const range_type* freeRanges, size_t freeCount, const range_type*, size_t, FitIndex& fit) {
+        ranges.clear();
+        fit.clear();
+
+        for (size_t i = 0; i < freeCount; ++i) {
+            ranges.emplace_hint(ranges.end(), freeRanges[i].offset, freeRanges[i].size);
+            fit.insert(freeRanges[i]);
+        }
+
+        return true;
+    }
+
+    size_t size() const { return ranges.size(); }
+    bool empty() const { return ranges.empty(); }
+
+    template <typename Fn>
+    void forEachRange(Fn&& fn) const {
+        for (auto& r : ranges) { fn(range_type{r.first, r.second}); }
+    }
+
+    iterator begin() { return ranges.begin(); }
+    iterator end() { return ranges.end(); }
+    static range_type rangeOf(iterator rangeIt) { return {rangeIt->first, rangeIt->second}; }
+    iterator lowerBound(size_type offset) { return ranges.lower_bound(offset); }
+    iterator find(size_type offset) { return ranges.find(offset); }
+
+    template <typename FitIndex>
+    bool allocRange(const request_type& request, FitIndex& fit, range_type& allocatedRange) {
+        auto rangeIt = fit.select(*this, request);
+        if (rangeIt == ranges.end()) { return false; }
+
+        range_type r = rangeOf(rangeIt);
+        size_type padding = request.padding(r.offset);
+        allocatedRange = {static_cast<size_type>(r.offset + padding), request.size};
+
+        range_type tail = {};
+        tail.offset = static_cast<size_type>(allocatedRange.offset + request.size);
+        tail.size = static_cast<size_type>(r.size - padding - request.size);
+        if (tail.size < request.minFragment) {
+            allocatedRange.size += tail.size;
+            tail.size = 0;
+        }
+
+        fit.erase(r);
+        auto nextRangeIt = std::next(rangeIt);
+
+        if (padding) {
+            rangeIt->second = padding;
+            fit.insert(rangeOf(rangeIt));
+
+            if (tail.size) {
+                ranges.emplace_hint(nextRangeIt, tail.offset, tail.size);
+                fit.insert(tail);
+            }
+        } else {
+            auto rangeNode = ranges.extract(rangeIt);
+            if (tail.size) {
+                rangeNode.key() = tail.offset;
+                rangeNode.mapped() = tail.size;
+                ranges.insert(nextRangeIt, std::move(rangeNode));
+                fit.insert(tail);
+            }
+        }
+
+        fit.onAlloc(allocatedRange);
+        return true;
+    }
+
+    template <typename FitIndex>
+    bool freeRange(range_type rr, FitIndex& fit) {
+        size_type rrEnd = rr.offset + rr.size;
+
+        auto nextRangeIt = ranges.upper_bound(rr.offset);
+        auto prevRangeIt = nextRangeIt != ranges.begin() ? std::prev(nextRangeIt) : ranges.end();
+
+        //
+        // Check for double-free error, the range must not overlap any of its neighbours.
+        //
+
+        if (prevRangeIt != ranges.end() && prevRangeIt->first + prevRangeIt->second > rr.offset) { return false; }
+        if (nextRangeIt != ranges.end() && nextRangeIt->first < rrEnd) { return false; }
+
+        bool mergesPrev = prevRangeIt != ranges.end() && prevRangeIt->first + prevRangeIt->second == rr.offset;
+        bool mergesNext = nextRangeIt != ranges.end() && nextRangeIt->first == rrEnd;
+
+        if (mergesNext) {
+            fit.erase(rangeOf(nextRangeIt));
+            rr.size += nextRangeIt->second;
+            nextRangeIt = ranges.erase(nextRangeIt);
+        }
+
+        if (mergesPrev) {
+            fit.erase(rangeOf(prevRangeIt));
+            prevRangeIt->second += rr.size;
+            fit.insert(rangeOf(prevRangeIt));
+            return true;
+        }
+
+        ranges.emplace_hint(nextRangeIt, rr.offset, rr.size);
+        fit.insert(rr);
+        return true;
+    }
+
+    template <typename FitIndex>
+    bool freeRangeHinted(range_type rr, bool, bool, FitIndex& fit) {
+        return freeRange(rr, fit);
+    }
+
+    template <typename FitIndex>
+    bool expandRange(range_type& block, size_type newSize, size_type minFragment, FitIndex& fit) {
+        size_type blockEnd = block.offset + block.size;
+        auto nextRangeIt = ranges.find(blockEnd);
+        if (nextRangeIt == ranges.end() || uint64_t(block.size) + nextRangeIt->second < newSize) { return false; }
+
+        size_type taken = newSize - block.size;
+        range_type next = rangeOf(nextRangeIt);
+        fit.erase(next);
+
+        auto rangeNode = ranges.extract(nextRangeIt);
+        if (next.size - taken < minFragment) {
+            block.size += next.size;
+            return true;
+        }
+
+        rangeNode.key() = next.offset + taken;
+        rangeNode.mapped() = next.size - taken;
+        auto insertResult = ranges.insert(std::move(rangeNode));
+        fit.insert(rangeOf(insertResult.position));
+        block.size = newSize;
+        return true;
+    }
+
+    template <typename FitIndex>
+    bool shrinkRange(range_type& block, size_type newSize, size_type minFragment, FitIndex& fit) {
+        size_type tail = block.size - newSize;
+        size_type blockEnd = block.offset + block.size;
+        auto nextRangeIt = ranges.find(blockEnd);
+
+        range_type r = {static_cast<size_type>(blockEnd - tail), tail};
+        if (nextRangeIt != ranges.end()) {
+            fit.erase(rangeOf(nextRangeIt));
+            r.size += nextRangeIt->second;
+            nextRangeIt = ranges.erase(nextRangeIt);
+        } else if (tail < minFragment) {
+            return false;
+        }
+
+        ranges.emplace_hint(nextRangeIt, r.offset, r.size);
+        fit.insert(r);
+        block.size = newSize;
+        return true;
+    }
+
+    bool freeRangeBefore(size_type offset, range_type& r) {
+        auto rangeIt = ranges.lower_bound(offset);
+        if (rangeIt == ranges.begin()) { return false; }
+
+        --rangeIt;
+        if (rangeIt->first + rangeIt->second != offset) { return false; }
+
+        r = rangeOf(rangeIt);
+        return true;
+    }
+
+    template <typename FitIndex, typename MoveFn>
+    bool slideRange(range_type& block, FitIndex& fit, MoveFn&& moveBytes) {
+        range_type pr = {};
+        if (!freeRangeBefore(block.offset, pr)) { return false; }
+
+        moveBytes();
+
+        size_type blockEnd = block.offset + block.size;
+        ranges.erase(pr.offset);
+        fit.erase(pr);
+
+        range_type r = {static_cast<size_type>(pr.offset + block.size), pr.size};
+        auto nextRangeIt = ranges.find(blockEnd);
+        if (nextRangeIt != ranges.end()) {
+            fit.erase(rangeOf(nextRangeIt));
+            r.size += nextRangeIt->second;
+            nextRangeIt = ranges.erase(nextRangeIt);
+        }
+
+        ranges.emplace_hint(nextRangeIt, r.offset, r.size);
+        fit.insert(r);
+        block.offset = pr.offset;
+        return true;
+    }
+
+    //
+    // Frees a batch of ranges sorted by offset, nothing is freed if any of them is invalid.
+    //
+
+    template <typename FitIndex>
+    bool freeRanges(const range_type* sortedRanges, size_t count, FitIndex& fit) {
+        uint64_t prevEnd = 0;
+        for (size_t j = 0; j < count; ++j) {
+            const range_type& rr = sortedRanges[j];
+            if (rr.offset < prevEnd) { return false; }
+            prevEnd = uint64_t(rr.offset) + rr.size;
+
+            auto nextRangeIt = ranges.upper_bound(rr.offset);
+            auto prevRangeIt = nextRangeIt != ranges.begin() ? std::prev(nextRangeIt) : ranges.end();
+            if (prevRangeIt != ranges.end() && prevRangeIt->first + prevRangeIt->second > rr.offset) { return false; }
+            if (nextRangeIt != ranges.end() && nextRangeIt->first < prevEnd) { return false; }
+        }
+
+        for (size_t j = 0; j < count; ++j) { freeRange(sortedRanges[j], fit); }
+        return true;
+    }
+};
+
+//
+// Two-level segregated fit store (TLSF).
+// Free blocks are bucketed by size into first-level classes (powers of two) split into 2^SecondLevelLog2 linear
+// second-level classes. Two bitmaps index the non-empty buckets, so a good-fit bucket is found with two bit scans.
+// The free lists live in band, like in the classic TLSF: a free block keeps its size and its list links right after
+// the block format header, and its own offset right before the trailer. Used blocks only have two bits out of band,
+// one for the MinBlockSize slot their first byte is in and one for the slot of their last byte. No block is smaller
+// than MinBlockSize, so a slot holds at most one block start and one block end, and the bits tell in O(1) whether
+// the physical neighbours of a block are free. The side bitmaps take 2 bits per MinBlockSize bytes of the container.
+// Blocks are at least MinBlockSize and large enough for the in-band fields, smaller requests and remainders are
+// rounded up. A container below that size holds no blocks.
+// Requests are rounded up to the next second-level class, so a request may fail while a block of the same class
+// that is slightly larger than the request is still free. This is the usual TLSF price for bounded latency.
+// The store is good-fit by construction and selects ranges itself, the allocator gives it an empty fit index.
+//
+
+template <typename SizeType, uint32_t SecondLevelLog2 = 4, SizeType MinBlockSize = 16>
+struct FixedAllocatorTlsfRanges {
+    static constexpr bool isRangeStore = true;
+    static constexpr bool selectsRanges = true;
+
+    using size_type = SizeType;
+    using range_type = FixedAllocatorRange<SizeType>;
+    using request_type = FixedAllocatorRequest<SizeType>;
+
+    static_assert(SecondLevelLog2 > 0 && SecondLevelLog2 <= 5, "Second level bitmap is 32 bits wide.");
+    static_assert(MinBlockSize && !(MinBlockSize & (MinBlockSize - 1)), "MinBlockSize must be a power of two.");
+
+    static constexpr size_type nullOffset = std::numeric_limits<size_type>::max();
+    static constexpr uint32_t secondLevelCount = 1u << SecondLevelLog2;
+    static constexpr uint32_t firstLevelCount = sizeof(size_type) * 8 - SecondLevelLog2 + 1;
+    static constexpr size_type minBlockSize = MinBlockSize;
+    static constexpr uint32_t slotLog2 = [] {
+        uint32_t log2 = 0;
+        while ((size_type(1) << log2) < MinBlockSize) { ++log2; }
+        return log2;
+    }();
+
+    //
+    // In-band fields of a free block, the links are offsets of the neighbours in its free list.
+    //
+
+    struct FreeLinks {
+        size_type size = 0;
+        size_type prevFree = nullOffset;
+        size_type nextFree = nullOffset;
+    };
+
+    static constexpr size_type linksSize = sizeof(FreeLinks);
+    static constexpr size_type footerSize = sizeof(size_type);
+
+    uint8_t* base = nullptr;
+    size_type containerSize = 0;
+    size_type linksOffset = 0;
+    size_type footerOffset = 0;
+    size_type minBlock = MinBlockSize;
+    size_t freeCount = 0;
+    std::vector<uint64_t> usedStarts{};
+    std::vector<uint64_t> usedEnds{};
+    uint64_t firstLevelBitmap = 0;
+    uint32_t secondLevelBitmaps[firstLevelCount] = {};
+    size_type freeHeads[firstLevelCount][secondLevelCount] = {};
+
+    //
+    // Takes the container and the block format from the observer and sizes the side bitmaps, the store holds
+    // no blocks.
+    //
+
+    template <typename FitIndex>
+    void clearBlocks(size_type size, FitIndex& fit) {
+        using layout_type = typename FitIndex::layout_type;
+
+        fit.clear();
+        base = fit.base;
+        containerSize = size;
+        linksOffset = layout_type::headerSize;
+        footerOffset = layout_type::trailerSize + footerSize;
+        minBlock = static_cast<size_type>(std::max<size_t>(MinBlockSize, size_t(linksOffset) + linksSize + footerOffset));
+
+        size_t slotCount = (size_t(size) >> slotLog2) + 1;
+        usedStarts.assign((slotCount + 63) / 64, 0);
+        usedEnds.assign((slotCount + 63) / 64, 0);
+
+        freeCount = 0;
+        firstLevelBitmap = 0;
+        for (uint32_t fl = 0; fl < firstLevelCount; ++fl) {
+            secondLevelBitmaps[fl] = 0;
+            for (uint32_t sl = 0; sl < secondLevelCount; ++sl) { freeHeads[fl][sl] = nullOffset; }
+        }
+    }
+
+    template <typename FitIndex>
+    void reset(size_type size, FitIndex& fit) {
+        clearBlocks(size, fit);
+        if (size >= minBlock) { insertFree(0, size, fit); }
+    }
+
+    //
+    // Fails and leaves the store unchanged if a block is below the minimum block size, e.g. blocks that were
+    // written by another range store.
+    //
+
+    template <typename FitIndex>
+    bool assign(const range_type* freeRanges, size_t freeCount, const range_type* usedRanges, size_t usedCount, FitIndex& fit) {
+        using layout_type = typename FitIndex::layout_type;
+
+        const size_t minSize = std::max<size_t>(MinBlockSize, size_t(layout_type::headerSize) + linksSize + layout_type::trailerSize + footerSize);
+        uint64_t end = 0;
+        for (size_t i = 0; i < freeCount; ++i) {
+            if (freeRanges[i].size < minSize) { return false; }
+            end = std::max(end, uint64_t(freeRanges[i].offset) + freeRanges[i].size);
+        }
+
+        for (size_t i = 0; i < usedCount; ++i) {
+            if (usedRanges[i].size < minSize) { return false; }
+            end = std::max(end, uint64_t(usedRanges[i].offset) + usedRanges[i].size);
+        }
+
+        clearBlocks(static_cast<size_type>(end), fit);
+        for (size_t i = 0; i < freeCount; ++i) { insertFree(freeRanges[i].offset, freeRanges[i].size, fit); }
+        for (size_t i = 0; i < usedCount; ++i) { markUsed(usedRanges[i], true); }
+        return true;
+    }
+
+    size_t size() const { return freeCount; }
+    bool empty() const { return 0 == freeCount; }
+
+    //
+    // Collects the free lists and sorts them by offset, for diagnostics and persistence only.
+    //
+
+    template <typename Fn>
+    void forEachRange(Fn&& fn) const {
+        std::vector<range_type> freeRanges;
+        freeRanges.reserve(freeCount);
+
+        for (uint32_t fl = 0; fl < firstLevelCount; ++fl) {
+            for (uint32_t sl = 0; sl < secondLevelCount; ++sl) {
+                for (size_type offset = freeHeads[fl][sl]; offset != nullOffset;) {
+                    FreeLinks links = readLinks(offset);
+                    freeRanges.push_back({offset, links.size});
+                    offset = links.nextFree;
+                }
+            }
+        }
+
+        std::sort(freeRanges.begin(), freeRanges.end(), [](const range_type& a, const range_type& b) { return a.offset < b.offset; });
+        for (const range_type& r : freeRanges) { fn(r); }
+    }
+
+    template <typename FitIndex>
+    bool allocRange(const request_type& request, FitIndex& fit, range_type& allocatedRange) {
+        if (!request.size) { return false; }
+
+        //
+        // Aligned requests search for a block that fits the worst-case padding.
+        // Blocks and fragments below the minimum block size are rounded up.
+        //
+
+        request_type blockRequest = request;
+        blockRequest.size = std::max(request.size, minBlock);
+        blockRequest.minFragment = std::max(request.minFragment, minBlock);
+
+        uint64_t searchSize = uint64_t(blockRequest.size) + blockRequest.maxPadding();
+        if (searchSize > std::numeric_limits<size_type>::max()) { return false; }
+
+        uint32_t fl = 0, sl = 0;
+        if (!mapSearch(static_cast<size_type>(searchSize), fl, sl)) { return false; }
+
+        ++request.probes;
+        size_type offset = findSuitable(fl, sl);
+        if (offset == nullOffset) { return false; }
+
+        size_type size = readLinks(offset).size;
+        removeFree(offset, size, fit);
+
+        //
+        // Split the padding and the remainder off into their own free blocks.
+        //
+
+        size_type padding = blockRequest.padding(offset);
+        if (padding) {
+            insertFree(offset, padding, fit);
+            offset += padding;
+            size -= padding;
+        }
+
+        if (size - blockRequest.size >= blockRequest.minFragment) {
+            insertFree(offset + blockRequest.size, size - blockRequest.size, fit);
+            size = blockRequest.size;
+        }
+
+        allocatedRange = {offset, size};
+        markUsed(allocatedRange, true);
+        fit.onAlloc(allocatedRange);
+        return true;
+    }
+
+    template <typename FitIndex>
+    bool freeRange(range_type rr, FitIndex& fit) {
+        if (!isUsed(rr)) { return false; }
+        markUsed(rr, false);
+
+        //
+        // Merge with the physical neighbours.
+        //
+
+        if (nextIsFree(rr)) {
+            size_type nextOffset = rr.offset + rr.size;
+            size_type nextSize = readLinks(nextOffset).size;
+            removeFree(nextOffset, nextSize, fit);
+            rr.size += nextSize;
+        }
+
+        if (prevIsFree(rr.offset)) {
+            size_type prevOffset = readFooter(rr.offset);
+            size_type prevSize = readLinks(prevOffset).size;
+            removeFree(prevOffset, prevSize, fit);
+            rr = {prevOffset, static_cast<size_type>(rr.size + prevSize)};
+        }
+
+        insertFree(rr.offset, rr.size, fit);
+        return true;
+    }
+
+    template <typename FitIndex>
+    bool freeRangeHinted(range_type rr, bool, bool, FitIndex& fit) {
+        return freeRange(rr, fit);
+    }
+
+    template <typename FitIndex>
+    bool expandRange(range_type& block, size_type newSize, size_type minFragment, FitIndex& fit) {
+        if (!isUsed(block) || !nextIsFree(block)) { return false; }
+
+        size_type nextOffset = block.offset + block.size;
+        size_type nextSize = readLinks(nextOffset).size;
+        if (uint64_t(block.size) + nextSize < newSize) { return false; }
+
+        removeFree(nextOffset, nextSize, fit);
+        markUsed(block, false);
+
+        size_type totalSize = block.size + nextSize;
+        if (totalSize - newSize >= std::max(minFragment, minBlock)) {
+            insertFree(block.offset + newSize, totalSize - newSize, fit);
+            totalSize = newSize;
+        }
+
+        block.size = totalSize;
+        markUsed(block, true);
+        return true;
+    }
+
+    template <typename FitIndex>
+    bool shrinkRange(range_type& block, size_type newSize, size_type minFragment, FitIndex& fit) {
+        if (!isUsed(block)) { return false; }
+
+        newSize = std::max(newSize, minBlock);
+        if (newSize >= block.size) { return false; }
+
+        //
+        // The tail joins a free block after this one, or becomes a free block of its own.
+        //
+
+        size_type tailSize = block.size - newSize;
+        if (nextIsFree(block)) {
+            size_type nextOffset = block.offset + block.size;
+            size_type nextSize = readLinks(nextOffset).size;
+            removeFree(nextOffset, nextSize, fit);
+            tailSize += nextSize;
+        } else if (tailSize < std::max(minFragment, minBlock)) {
+            return false;
+        }
+
+        markUsed(block, false);
+        block.size = newSize;
+        markUsed(block, true);
+        insertFree(block.offset + newSize, tailSize, fit);
+        return true;
+    }
+
+    bool freeRangeBefore(size_type offset, range_type& r) const {
+        if (offset >= containerSize || !testSlot(usedStarts, offset) || !prevIsFree(offset)) { return false; }
+
+        size_type prevOffset = readFooter(offset);
+        r = {prevOffset, readLinks(prevOffset).size};
+        return true;
+    }
+
+    //
+    // The block takes the start of the free block before it, which moves behind the block. The bytes are moved
+    // by moveBytes() once the in-band fields of the free block were read, since the block lands on top of them.
+    //
+
+    template <typename FitIndex, typename MoveFn>
+    bool slideRange(range_type& block, FitIndex& fit, MoveFn&& moveBytes) {
+        if (!isUsed(block) || !prevIsFree(block.offset)) { return false; }
+
+        size_type prevOffset = readFooter(block.offset);
+        size_type freeSize = readLinks(prevOffset).size;
+        removeFree(prevOffset, freeSize, fit);
+
+        if (nextIsFree(block)) {
+            size_type nextOffset = block.offset + block.size;
+            size_type nextSize = readLinks(nextOffset).size;
+            removeFree(nextOffset, nextSize, fit);
+            freeSize += nextSize;
+        }
+
+        markUsed(block, false);
+        moveBytes();
+
+        block.offset = prevOffset;
+        markUsed(block, true);
+        insertFree(block.offset + block.size, freeSize, fit);
+        return true;
+    }
+
+    template <typename FitIndex>
+    bool freeRanges(const range_type* sortedRanges, size_t count, FitIndex& fit) {
+        for (size_t j = 0; j < count; ++j) {
+            if (!isUsed(sortedRanges[j])) { return false; }
+            if (j && sortedRanges[j - 1].offset == sortedRanges[j].offset) { return false; }
+        }
+
+        for (size_t j = 0; j < count; ++j) { freeRange(sortedRanges[j], fit); }
+        return true;
+    }
+
+    static void mapInsert(size_type size, uint32_t& fl, uint32_t& sl) {
+        if (size < secondLevelCount) {
+            fl = 0;
+            sl = static_cast<uint32_t>(size);
+            return;
+        }
+
+        uint32_t msb = detail::findLastSet(size);
+        fl = msb - SecondLevelLog2 + 1;
+        sl = static_cast<uint32_t>(size >> (msb - SecondLevelLog2)) ^ secondLevelCount;
+    }
+
+    static bool mapSearch(size_type size, uint32_t& fl, uint32_t& sl) {
+        uint64_t roundedSize = size;
+        if (size >= secondLevelCount) {
+            uint32_t msb = detail::findLastSet(size);
+            roundedSize += (uint64_t(1) << (msb - SecondLevelLog2)) - 1;
+        }
+
+        if (roundedSize > std::numeric_limits<size_type>::max()) { return false; }
+        mapInsert(static_cast<size_type>(roundedSize), fl, sl);
+        return true;
+    }
+
+    size_type findSuitable(uint32_t fl, uint32_t sl) const {
+        uint32_t slMap = sl < 32 ? secondLevelBitmaps[fl] & (~0u << sl) : 0;
+        if (!slMap) {
+            uint64_t flMap = fl + 1 < 64 ? firstLevelBitmap & (~uint64_t(0) << (fl + 1)) : 0;
+            if (!flMap) { return nullOffset; }
+
+            fl = detail::findFirstSet(flMap);
+            slMap = secondLevelBitmaps[fl];
+        }
+
+        sl = detail::findFirstSet(slMap);
+        return freeHeads[fl][sl];
+    }
+
+    //
+    // Slot bits of used blocks. The block that starts (ends) in a slot is the only one that does, so a neighbour
+    // offset whose slot bit is clear belongs to a free block.
+    //
+
+    static bool testSlot(const std::vector<uint64_t>& slots, size_type offset) {
+        size_t slot = offset >> slotLog2;
+        return (slots[slot >> 6] >> (slot & 63)) & 1;
+    }
+
+    static void setSlot(std::vector<uint64_t>& slots, size_type offset, bool used) {
+        size_t slot = offset >> slotLog2;
+        if (used) {
+            slots[slot >> 6] |= uint64_t(1) << (slot & 63);
+        } else {
+            slots[slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+        }
+    }
+
+    void markUsed(const range_type& r, bool used) {
+        setSlot(usedStarts, r.offset, used);
+        setSlot(usedEnds, r.offset + r.size - 1, used);
+    }
+
+    bool isUsed(const range_type& r) const {
+        if (r.size < minBlock || r.offset >= containerSize || r.size > containerSize - r.offset) { return false; }
+        return testSlot(usedStarts, r.offset) && testSlot(usedEnds, r.offset + r.size - 1);
+    }
+
+    bool nextIsFree(const range_type& r) const {
+        size_type nextOffset = r.offset + r.size;
+        return nextOffset < containerSize && !testSlot(usedStarts, nextOffset);
+    }
+
+    bool prevIsFree(size_type offset) const { return offset && !testSlot(usedEnds, offset - 1); }
+
+    //
+    // In-band fields are copied, free blocks have no alignment.
+    //
+
+    FreeLinks readLinks(size_type offset) const {
+        FreeLinks links;
+        std::memcpy(&links, base + offset + linksOffset, sizeof(links));
+        return links;
+    }
+
+    void writeLinks(size_type offset, const FreeLinks& links) { std::memcpy(base + offset + linksOffset, &links, sizeof(links)); }
+
+    size_type readFooter(size_type end) const {
+        size_type offset = 0;
+        std::memcpy(&offset, base + end - footerOffset, sizeof(offset));
+        return offset;
+    }
+
+    template <typename FitIndex>
+    void insertFree(size_type offset, size_type size, FitIndex& fit) {
+        uint32_t fl = 0, sl = 0;
+        mapInsert(size, fl, sl);
+
+        //
+        // The observer writes the block format tags first, the in-band fields sit between them.
+        //
+
+        fit.insert({offset, size});
+
+        FreeLinks links;
+        links.size = size;
+        links.nextFree = freeHeads[fl][sl];
+        writeLinks(offset, links);
+        std::memcpy(base + offset + size - footerOffset, &offset, sizeof(offset));
+
+        if (links.nextFree != nullOffset) {
+            FreeLinks nextLinks = readLinks(links.nextFree);
+            nextLinks.prevFree = offset;
+            writeLinks(links.nextFree, nextLinks);
+        }
+
+        freeHeads[fl][sl] = offset;
+        firstLevelBitmap |= uint64_t(1) << fl;
+        secondLevelBitmaps[fl] |= 1u << sl;
+        ++freeCount;
+    }
+
+    template <typename FitIndex>
+    void removeFree(size_type offset, size_type size, FitIndex& fit) {
+        uint32_t fl = 0, sl = 0;
+        mapInsert(size, fl, sl);
+
+        FreeLinks links = readLinks(offset);
+        if (links.prevFree != nullOffset) {
+            FreeLinks prevLinks = readLinks(links.prevFree);
+            prevLinks.nextFree = links.nextFree;
+            writeLinks(links.prevFree, prevLinks);
+        }
+
+        if (links.nextFree != nullOffset) {
+            FreeLinks nextLinks = readLinks(links.nextFree);
+            nextLinks.prevFree = links.prevFree;
+            writeLinks(links.nextFree, nextLinks);
+        }
+
+        if (freeHeads[fl][sl] == offset) {
+            freeHeads[fl][sl] = links.nextFree;
+            if (links.nextFree == nullOffset) {
+                secondLevelBitmaps[fl] &= ~(1u << sl);
+                if (!secondLevelBitmaps[fl]) { firstLevelBitmap &= ~(uint64_t(1) << fl); }
+            }
+        }
+
+        --freeCount;
+        fit.erase({offset, size});
+    }
+};
+
+namespace detail {
+
+template <typename SizeType, typename RangeVectorType, typename = void>
+struct FixedAllocatorRangeStoreSelector {
+    using type = FixedAllocatorRangeVector<SizeType, RangeVectorType>;
+};
+
+template <typename SizeType, typename RangeVectorType>
+struct FixedAllocatorRangeStoreSelector<SizeType, RangeVectorType, std::enable_if_t<RangeVectorType::isRangeStore>> {
+    static_assert(std::is_same<SizeType, typename RangeVectorType::size_type>::value, "Range store size type mismatch.");
+    using type = RangeVectorType;
+};
+
+//
+// Containers that mark themselves with `decommitsFreeRanges` get decommitFreeRange() calls from the free paths.
+//
+
+template <typename ContainerType, typename = void>
+struct FixedAllocatorContainerDecommits : std::false_type {};
+
+template <typename ContainerType>
+struct FixedAllocatorContainerDecommits<ContainerType, std::enable_if_t<ContainerType::decommitsFreeRanges>> : std::true_type {};
+
+//
+// Smallest block a range store hands out, stores that keep exact block sizes do not declare `minBlockSize`.
+//
+
+template <typename RangeStore, typename = void>
+struct FixedAllocatorRangeStoreMinBlockSize : std::integral_constant<size_t, 1> {};
+
+template <typename RangeStore>
+struct FixedAllocatorRangeStoreMinBlockSize<RangeStore, std::void_t<decltype(RangeStore::minBlockSize)>>
+    : std::integral_constant<size_t, RangeStore::minBlockSize> {};
+
+//
+// Bytes of a free range a range store keeps in band (right after the header and right before the trailer).
+//
+
+template <typename RangeStore, typename = void>
+struct FixedAllocatorRangeStoreInBand {
+    static constexpr size_t front = 0;
+    static constexpr size_t back = 0;
+};
+
+template <typename RangeStore>
+struct FixedAllocatorRangeStoreInBand<RangeStore, std::void_t<decltype(RangeStore::linksSize)>> {
+    static constexpr size_t front = RangeStore::linksSize;
+    static constexpr size_t back = RangeStore::footerSize;
+};
+
+//
+// Stores that select ranges themselves (`selectsRanges`) never ask the fit index, they get FirstFit's empty one
+// so that no index is maintained for nothing.
+//
+
+template <typename SizeType, typename FitPolicy, typename RangeStore, typename = void>
+struct FixedAllocatorFitIndexSelector {
+    using type = typename FitPolicy::template Index<SizeType>;
+};
+
+template <typename SizeType, typename FitPolicy, typename RangeStore>
+struct FixedAllocatorFitIndexSelector<SizeType, FitPolicy, RangeStore, std::enable_if_t<RangeStore::selectsRanges>> {
+    using type = typename defaults::FirstFitPolicy::template Index<SizeType>;
+};
+}
+
+//
+// Constructor tag: the container already holds blocks (a remapped persistent arena), the allocator starts empty
+// and takes its free ranges from restore() or recover().
+//
+
+struct FixedAllocatorAttach {};
+
+template <typename SizeType,
+          typename ContainerType,
+          typename RangeVectorType = std::vector<FixedAllocatorRange<SizeType>>,
+          typename ExceptionPolicy = defaults::DefaultExceptionPolicy,
+          typename LockPolicy = defaults::DefaultSingleThreadedLockPolicy,
+          typename FitPolicy = defaults::FirstFitPolicy,
+          typename BlockFormat = defaults::SizeHeaderBlockFormat,
+          typename InstrumentationPolicy = defaults::NoInstrumentationPolicy>
+struct FixedAllocator {
+    using size_type = SizeType;
+    using container_type = ContainerType;
+    using exception_policy = ExceptionPolicy;
+    using lock_policy = LockPolicy;
+    using range_type = FixedAllocatorRange<SizeType>;
+    using request_type = FixedAllocatorRequest<SizeType>;
+    using range_store_type = typename detail::FixedAllocatorRangeStoreSelector<SizeType, RangeVectorType>::type;
+    using fit_index_type = typename detail::FixedAllocatorFitIndexSelector<SizeType, FitPolicy, range_store_type>::type;
+    using layout_type = typename BlockFormat::template Layout<SizeType>;
+    using observer_type = detail::FixedAllocatorRangeObserver<fit_index_type, layout_type>;
+    using instrumentation_type = InstrumentationPolicy;
+    using sample_type = detail::FixedAllocatorSample<InstrumentationPolicy>;
+    using size_registry_type = detail::FixedAllocatorSizeRegistry<SizeType, layout_type::checkSizes>;
+    static constexpr size_type headerSize = layout_type::headerSize;
+    static constexpr size_type trailerSize = layout_type::trailerSize;
+
+    static_assert(!layout_type::headerless || detail::FixedAllocatorRangeStoreMinBlockSize<range_store_type>::value == 1,
+                  "Headerless blocks are freed by size, the range store must not round block sizes up.");
+
+    const ContainerType container{};
+    range_store_type freeBufferRanges{};
+    fit_index_type fitIndex{};
+    detail::FixedAllocatorCounters counters{};
+    InstrumentationPolicy instrumentation{};
+    size_registry_type sizeRegistry{};
+    mutable typename LockPolicy::Lock lock{};
+
+    explicit FixedAllocator(const ContainerType& c) : container(c) { init(); }
+    explicit FixedAllocator(ContainerType&& c) : container(std::move(c)) { init(); }
+    FixedAllocator(const ContainerType& c, FixedAllocatorAttach) : container(c) {}
+
+    void init() {
+        assert(container.size() < std::numeric_limits<size_type>::max());
+        assert(!layout_type::boundaryTags || container.empty() || container.size() >= layout_type::minFragmentSize);
+        if constexpr (layout_type::boundaryTags) { assert(container.size() < layout_type::freeBit); }
+
+        auto rangeObserver = observer();
+        freeBufferRanges.reset(static_cast<size_type>(container.size()), rangeObserver);
+    }
+
+    observer_type observer() {
+        return observer_type{fitIndex, counters, container.data()};
+    }
+
+    auto freeObserver(const range_type& freed) {
+        if constexpr (detail::FixedAllocatorContainerDecommits<ContainerType>::value) {
+            using in_band_type = detail::FixedAllocatorRangeStoreInBand<range_store_type>;
+            return detail::FixedAllocatorDecommitObserver<fit_index_type, layout_type, ContainerType, in_band_type::front, in_band_type::back>{
+                observer(), container, freed};
+        } else {
+            return observer();
+        }
+    }
+
+    //
+    // Rebuilds the free ranges of an attached container. restore() takes the free ranges saved with
+    // forEachFreeRange() and walks the used blocks between them through their headers, recover() needs boundary
+    // tags and walks the whole container. Both return false and leave the allocator unchanged if the blocks
+    // do not add up.
+    //
+
+    bool restore(const range_type* freeRanges, size_t count) {
+        static_assert(!layout_type::headerless, "Headerless blocks cannot be walked.");
+        typename LockPolicy::UniqueLockGuard lockGuard(lock);
+
+        std::vector<range_type> freeBlocks = {};
+        std::vector<range_type> usedBlocks = {};
+
+        uint64_t offset = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const range_type& r = freeRanges[i];
+            if (!r.size || r.offset < offset || uint64_t(r.offset) + r.size > container.size()) { return false; }
+            if (!walkUsedBlocks(offset, r.offset, usedBlocks)) { return false; }
+
+            if (!freeBlocks.empty() && freeBlocks.back().offset + freeBlocks.back().size == r.offset) {
+                freeBlocks.back().size += r.size;
+            } else {
+                freeBlocks.push_back(r);
+            }
+
+            offset = uint64_t(r.offset) + r.size;
+        }
+
+        if (!walkUsedBlocks(offset, container.size(), usedBlocks)) { return false; }
+        return assignBlocks(freeBlocks, usedBlocks);
+    }
+
+    bool recover() {
+        static_assert(layout_type::boundaryTags, "Recovery walks boundary tags.");
+        typename LockPolicy::UniqueLockGuard lockGuard(lock);
+
+        std::vector<range_type> freeBlocks = {};
+        std::vector<range_type> usedBlocks = {};
+
+        uint8_t* base = container.data();
+        uint64_t offset = 0;
+        while (offset < container.size()) {
+            const uint8_t* headerPtr = base + offset;
+            if (container.size() - offset < layout_type::minFragmentSize) { return false; }
+
+            range_type r = {static_cast<size_type>(offset), layout_type::chunkSize(headerPtr)};
+            if (r.size < layout_type::minFragmentSize || r.size > container.size() - offset) { return false; }
+            if (layout_type::tag(headerPtr + r.size - trailerSize) != layout_type::tag(headerPtr)) { return false; }
+
+            if (!layout_type::isFree(headerPtr)) {
+                usedBlocks.push_back(r);
+            } else if (!freeBlocks.empty() && freeBlocks.back().offset + freeBlocks.back().size == r.offset) {
+                freeBlocks.back().size += r.size;
+            } else {
+                freeBlocks.push_back(r);
+            }
+
+            offset += r.size;
+        }
+
+        return assignBlocks(freeBlocks, usedBlocks);
+    }
+
+    //
+    // Used blocks must tile [offset, end) exactly, the lock is held by the caller.
+    //
+
+    bool walkUsedBlocks(uint64_t offset, uint64_t end, std::vector<range_type>& usedBlocks) const {
+        const uint8_t* base = container.data();
+        while (offset < end) {
+            if (end - offset < uint64_t(headerSize) + trailerSize) { return false; }
+
+            const uint8_t* headerPtr = base + offset;
+            range_type r = {static_cast<size_type>(offset), layout_type::chunkSize(headerPtr)};
+            if (r.size < chunkSizeOf(0) || r.size > end - offset) { return false; }
+
+            if constexpr (layout_type::boundaryTags) {
+                if (layout_type::isFree(headerPtr)) { return false; }
+                if (layout_type::tag(headerPtr + r.size - trailerSize) != layout_type::tag(headerPtr)) { return false; }
+            }
+
+            usedBlocks.push_back(r);
+            offset += r.size;
+        }
+
+        return true;
+    }
+
+    bool assignBlocks(const std::vector<range_type>& freeBlocks, const std::vector<range_type>& usedBlocks) {
+        auto rangeObserver = observer();
+        if (!freeBufferRanges.assign(freeBlocks.data(), freeBlocks.size(), usedBlocks.data(), usedBlocks.size(), rangeObserver)) {
+            return false;
+        }
+
+        counters.addAllocations(usedBlocks.size(), container.size());
+        return true;
+    }
+
+    template <typename Fn>
+    void forEachFreeRange(Fn&& fn) const {
+        typename LockPolicy::SharedLockGuard lockGuard(lock);
+        freeBufferRanges.forEachRange(fn);
+    }
+
+    //
+    // Chunk size of a block with the payload size, headerless blocks take at least one byte.
+    //
+
+    static size_type chunkSizeOf(size_type size) {
+        return static_cast<size_type>(std::max<uint64_t>(uint64_t(size) + headerSize + trailerSize, 1));
+    }
+
+    defaults::ByteSpan allocByteSpan(size_type size) {
+        return allocByteSpanAligned(size, 1);
+    }
+
+    //
+    // The header is placed right before the aligned payload, so free() works unchanged.
+    // Alignment must be a power of two.
+    //
+
+    defaults::ByteSpan allocByteSpanAligned(size_type size, size_type alignment) {
+        if (!alignment || (alignment & (alignment - 1))) { assert(false); return {}; }
+
+        sample_type sample(instrumentation);
+        typename LockPolicy::UniqueLockGuard lockGuard(lock);
+        sample.lockAcquired();
+
+        auto allocatedSpan = allocByteSpanUnlocked(size, alignment);
+        sample.allocDone();
+        return allocatedSpan;
+    }
+
+    defaults::ByteSpan allocByteSpanUnlocked(size_type size, size_type alignment) {
+        if (container.empty() || freeBufferRanges.empty()) {
+            if constexpr (InstrumentationPolicy::enabled) { instrumentation.onAlloc(size, false, 0); }
+            return {};
+        }
+
+        request_type request = {};
+        request.size = chunkSizeOf(size);
+        request.alignment = alignment;
+        request.minFragment = layout_type::minFragmentSize;
+        request.alignBase = reinterpret_cast<uintptr_t>(container.data()) + headerSize;
+
+        auto rangeObserver = observer();
+
+        range_type r = {};
+        bool allocated = freeBufferRanges.allocRange(request, rangeObserver, r);
+        if constexpr (InstrumentationPolicy::enabled) { instrumentation.onAlloc(size, allocated, request.probes); }
+        if (!allocated) { return {}; }
+
+        layout_type::writeUsed(container.data(), r);
+        sizeRegistry.insert(r);
+        counters.addAllocations(1, container.size());
+
+        uint8_t* allocPtr = container.data() + r.offset + headerSize;
+        return defaults::ByteSpan(allocPtr, size);
+    }
+
+    void* alloc(size_type size) {
+        auto allocatedSpan = allocByteSpan(size);
+        return allocatedSpan.data();
+    }
+
+    void* allocAligned(size_type size, size_type alignment) {
+        auto allocatedSpan = allocByteSpanAligned(size, alignment);
+        return allocatedSpan.data();
+    }
+
+    //
+    // Allocates count blocks under a single lock acquisition, blocks that do not fit come back as nullptr.
+    // Returns the number of allocated blocks.
+    //
+
+    size_t allocBatch(const size_type* sizes, size_t count, void** outPtrs) {
+        sample_type sample(instrumentation);
+        typename LockPolicy::UniqueLockGuard lockGuard(lock);
+        sample.lockAcquired();
+
+        size_t allocatedCount = 0;
+        for (size_t i = 0; i < count; ++i) {
+            outPtrs[i] = allocByteSpanUnlocked(sizes[i], 1).data();
+            if (outPtrs[i]) { ++allocatedCount; }
+        }
+
+        sample.allocDone();
+        return allocatedCount;
+    }
+
+    //
+    // Frees the block which chunk (header included) is the range, with the same checks and accounting as free().
+    //
+
+    bool freeRange(range_type rr) noexcept(ExceptionPolicy::NoexceptFree) {
+        sample_type sample(instrumentation);
+        typename LockPolicy::UniqueLockGuard lockGuard(lock);
+        sample.lockAcquired();
+
+        return freeChunkUnlocked(rr, sample);
+    }
+
+    void onFreed(const range_type& r) {
+        if constexpr (InstrumentationPolicy::enabled) { instrumentation.onFree(r.size - headerSize - trailerSize); }
+    }
+
+    //
+    // Frees the block which header starts at the offset, the size is read from the header.
+    //
+
+    bool freeBlock(size_type offset) {
+        static_assert(!layout_type::headerless, "Headerless blocks are freed with free(ptr, size).");
+
+        sample_type sample(instrumentation);
+        typename LockPolicy::UniqueLockGuard lockGuard(lock);
+        sample.lockAcquired();
+
+        range_type r = {offset, layout_type::chunkSize(container.data() + offset)};
+        return freeChunkUnlocked(r, sample);
+    }
+
+    //
+    // Frees the block at the offset with the chunk size given by the caller (sized deallocation).
+    //
+
+    bool freeSizedBlock(size_type offset, size_type chunkSize) {
+        sample_type sample(instrumentation);
+        typename LockPolicy::UniqueLockGuard lockGuard(lock);
+        sample.lockAcquired();
+
+        return freeChunkUnlocked(range_type{offset, chunkSize}, sample);
+    }
+
+    bool freeChunkUnlocked(const range_type& r, sample_type& sample) {
+        uint8_t* base = container.data();
+        if (!r.size || r.offset >= container.size() || r.size > container.size() - r.offset) { return false; }
+        if (!sizeRegistry.contains(r)) { return false; }
+
+        auto rangeObserver = freeObserver(r);
+        if constexpr (!layout_type::boundaryTags) {
+            if (!freeBufferRanges.freeRange(r, rangeObserver)) { return false; }
+
+            sizeRegistry.erase(r);
+            counters.removeAllocations(1);
+            onFreed(r);
+            sample.freeDone();
+            return true;
+        } else {
+            if (layout_type::isFree(base + r.offset)) { return false; }
+
+            size_type rEnd = r.offset + r.size;
+            bool prevIsFree = r.offset >= trailerSize && layout_type::isFree(base + r.offset - trailerSize);
+            bool nextIsFree = rEnd < container.size() && layout_type::isFree(base + rEnd);
+
+            //
+            // Tag the block itself as free first, so that freeing it again is caught even when it ends up
+            // in the middle of a coalesced range.
+            //
+
+            layout_type::writeFree(base, r);
+            if (!freeBufferRanges.freeRangeHinted(r, prevIsFree, nextIsFree, rangeObserver)) {
+                layout_type::writeUsed(base, r);
+                return false;
+            }
+
+            counters.removeAllocations(1);
+            onFreed(r);
+            sample.freeDone();
+            return true;
+        }
+    }
+
+    void free(void* dataPtr) noexcept(ExceptionPolicy::NoexceptFree) {
+        static_assert(!layout_type::headerless, "Headerless blocks are freed with free(ptr, size).");
+        if (!dataPtr || container.empty()) { return; }
+
+        auto c = container.data();
+        auto cEnd = c + container.size();
+
+        if (dataPtr < c || dataPtr >= cEnd) {
+            ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is out of bounds.");
+        }
+
+        uintptr_t allocAddress = reinterpret_cast<uintptr_t>(dataPtr);
+        uintptr_t containerDataAddress = reinterpret_cast<uintptr_t>(container.data());
+        uintptr_t offset = allocAddress - containerDataAddress;
+
+        if (offset < headerSize) { assert(false); return; }
+        offset -= headerSize;
+
+        if (!freeBlock(static_cast<size_type>(offset))) {
+            ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is already free.");
+        }
+    }
+
+    //
+    // Sized deallocation, size is the payload size passed to alloc. Required for headerless blocks,
+    // the other formats read the size from the header and only check it in debug builds.
+    //
+
+    void free(void* dataPtr, size_type size) noexcept(ExceptionPolicy::NoexceptFree) {
+        if constexpr (!layout_type::headerless) {
+            assert(!dataPtr || allocationSize(dataPtr) >= size);
+            free(dataPtr);
+        } else {
+            if (!dataPtr || container.empty()) { return; }
+
+            auto c = container.data();
+            if (dataPtr < c || dataPtr >= c + container.size()) {
+                ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is out of bounds.");
+            }
+
+            size_type offset = static_cast<size_type>(reinterpret_cast<uint8_t*>(dataPtr) - c);
+            if (!freeSizedBlock(offset, chunkSizeOf(size))) {
+                ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is already free or has a different size.");
+            }
+        }
+    }
+
+    //
+    // In-place resizing. The block grows into the free range right after it, or gives its tail back to it.
+    // Both update the header (and footer) and never move the payload. Sizes are payload sizes.
+    //
+
+    bool tryExpandInPlace(void* dataPtr, size_type newSize) {
+        return resizeInPlace(dataPtr, newSize, true);
+    }
+
+    bool shrinkInPlace(void* dataPtr, size_type newSize) {
+        return resizeInPlace(dataPtr, newSize, false);
+    }
+
+    bool resizeInPlace(void* dataPtr, size_type newSize, bool expand) {
+        static_assert(!layout_type::headerless, "Headerless blocks cannot be resized in place.");
+        if (!dataPtr || container.empty()) { return false; }
+
+        uint8_t* base = container.data();
+        uint8_t* headerPtr = reinterpret_cast<uint8_t*>(dataPtr) - headerSize;
+        if (headerPtr < base || headerPtr >= base + container.size()) { assert(false); return false; }
+
+        typename LockPolicy::UniqueLockGuard lockGuard(lock);
+
+        range_type r = {static_cast<size_type>(headerPtr - base), layout_type::chunkSize(headerPtr)};
+        if constexpr (layout_type::boundaryTags) {
+            if (layout_type::isFree(headerPtr)) { assert(false); return false; }
+        }
+
+        uint64_t newChunkSize = uint64_t(newSize) + headerSize + trailerSize;
+        if (newChunkSize > std::numeric_limits<size_type>::max()) { return false; }
+        if (expand ? newChunkSize <= r.size : newChunkSize >= r.size) { return true; }
+
+        auto rangeObserver = observer();
+        bool resized = expand ? freeBufferRanges.expandRange(r, static_cast<size_type>(newChunkSize), layout_type::minFragmentSize, rangeObserver)
+                              : freeBufferRanges.shrinkRange(r, static_cast<size_type>(newChunkSize), layout_type::minFragmentSize, rangeObserver);
+        if (!resized) { return false; }
+
+        layout_type::writeUsed(base, r);
+        counters.updateHighWaterMark(container.size());
+        return true;
+    }
+
+    //
+    // Moves a used block down to the start of the free range right before it, header and payload included.
+    // Returns the new payload address, or nullptr if the block does not follow a free range.
+    // The payload keeps the default alignment only, blocks from allocAligned() should not be moved.
+    //
+
+    void* slideDown(void* dataPtr) {
+        static_assert(!layout_type::headerless, "Headerless blocks cannot be moved.");
+        if (!dataPtr || container.empty()) { return nullptr; }
+
+        uint8_t* base = container.data();
+        uint8_t* headerPtr = reinterpret_cast<uint8_t*>(dataPtr) - headerSize;
+        if (headerPtr < base || headerPtr >= base + container.size()) { assert(false); return nullptr; }
+
+        typename LockPolicy::UniqueLockGuard lockGuard(lock);
+
+        range_type r = {static_cast<size_type>(headerPtr - base), layout_type::chunkSize(headerPtr)};
+        range_type pr = {};
+        if (!freeBufferRanges.freeRangeBefore(r.offset, pr)) { return nullptr; }
+
+        //
+        // The store moves the bytes once it no longer needs the free range contents and before the free range
+        // tags are written over the old location.
+        //
+
+        auto rangeObserver = observer();
+        freeBufferRanges.slideRange(r, rangeObserver, [&] { std::memmove(base + pr.offset, headerPtr, r.size); });
+        layout_type::writeUsed(base, r);
+        return base + r.offset + headerSize;
+    }
+
+    //
+    // Resizes in place when possible, otherwise moves the payload to a new block (alloc, copy, free).
+    // A moved block is not aligned beyond the default alignment. Returns nullptr and keeps the block if it
+    // cannot grow.
+    //
+
+    void* realloc(void* dataPtr, size_type newSize) {
+        if (!dataPtr) { return alloc(newSize); }
+        if (!newSize) {
+            free(dataPtr);
+            return nullptr;
+        }
+
+        size_type oldSize = allocationSize(dataPtr);
+        if (newSize <= oldSize) {
+            shrinkInPlace(dataPtr, newSize);
+            return dataPtr;
+        }
+
+        if (tryExpandInPlace(dataPtr, newSize)) { return dataPtr; }
+
+        void* movedPtr = alloc(newSize);
+        if (!movedPtr) { return nullptr; }
+
+        std::memcpy(movedPtr, dataPtr, oldSize);
+        free(dataPtr);
+        return movedPtr;
+    }
+
+    //
+    // Frees count blocks under a single lock acquisition, null pointers are skipped.
+    // The released ranges are sorted by offset and merged into the free list in one pass.
+    // The batch is all or nothing: if any of the blocks is already free, none of them is freed.
+    //
+
+    void freeBatch(void* const* dataPtrs, size_t count) noexcept(ExceptionPolicy::NoexceptFree) {
+        if (container.empty()) { return; }
+
+        auto c = container.data();
+        auto cEnd = c + container.size();
+
+        for (size_t i = 0; i < count; ++i) {
+            if (dataPtrs[i] && (dataPtrs[i] < c + headerSize || dataPtrs[i] >= cEnd)) {
+                ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is out of bounds.");
+                return;
+            }
+        }
+
+        if (!freeBlocks(dataPtrs, count)) {
+            ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is already free.");
+        }
+    }
+
+    bool freeBlocks(void* const* dataPtrs, size_t count) {
+        static_assert(!layout_type::headerless, "Headerless blocks are freed with free(ptr, size).");
+
+        //
+        // The scratch ranges live on the stack (or in a local vector for large batches), never in the allocator,
+        // so an allocator placed in shared memory holds no process-local state.
+        //
+
+        constexpr size_t stackRangeCount = 64;
+        range_type stackRanges[stackRangeCount];
+        std::vector<range_type> heapRanges;
+        if (count > stackRangeCount) { heapRanges.resize(count); }
+        range_type* batchRanges = count > stackRangeCount ? heapRanges.data() : stackRanges;
+        size_t batchCount = 0;
+
+        sample_type sample(instrumentation);
+        typename LockPolicy::UniqueLockGuard lockGuard(lock);
+        sample.lockAcquired();
+
+        uint8_t* base = container.data();
+
+        for (size_t i = 0; i < count; ++i) {
+            if (!dataPtrs[i]) { continue; }
+
+            size_type offset = static_cast<size_type>(reinterpret_cast<uint8_t*>(dataPtrs[i]) - base - headerSize);
+            range_type r = {offset, layout_type::chunkSize(base + offset)};
+            if (!r.size || r.size > container.size() - offset) { return false; }
+            if constexpr (layout_type::boundaryTags) {
+                if (layout_type::isFree(base + offset)) { return false; }
+            }
+
+            batchRanges[batchCount++] = r;
+        }
+
+        std::sort(batchRanges, batchRanges + batchCount, [](const range_type& a, const range_type& b) {
+            return a.offset < b.offset;
+        });
+
+        if constexpr (layout_type::boundaryTags) {
+            for (size_t i = 0; i < batchCount; ++i) { layout_type::writeFree(base, batchRanges[i]); }
+        }
+
+        range_type batchSpan = {};
+        if (batchCount) {
+            const range_type& lastRange = batchRanges[batchCount - 1];
+            batchSpan = {batchRanges[0].offset, static_cast<size_type>(lastRange.offset + lastRange.size - batchRanges[0].offset)};
+        }
+
+        auto rangeObserver = freeObserver(batchSpan);
+        if (!freeBufferRanges.freeRanges(batchRanges, batchCount, rangeObserver)) {
+            if constexpr (layout_type::boundaryTags) {
+                for (size_t i = 0; i < batchCount; ++i) { layout_type::writeUsed(base, batchRanges[i]); }
+            }
+
+            return false;
+        }
+
+        counters.removeAllocations(batchCount);
+        for (size_t i = 0; i < batchCount; ++i) { onFreed(batchRanges[i]); }
+        return true;
+    }
+
+    //
+    // Payload size of a live allocation, read from its header.
+    //
+
+    size_type allocationSize(const void* dataPtr) const {
+        static_assert(!layout_type::headerless, "Headerless blocks do not record their size.");
+        const uint8_t* headerPtr = reinterpret_cast<const uint8_t*>(dataPtr) - headerSize;
+        return static_cast<size_type>(layout_type::chunkSize(headerPtr) - headerSize - trailerSize);
+    }
+
+    size_type totalOccupiedSpace() const {
+        return container.size() - totalFreeSpace();
+    }
+
+    size_type totalFreeSpace() const {
+        return static_cast<size_type>(counters.freeBytes.load(std::memory_order_relaxed));
+    }
+
+    //
+    // O(1) snapshot of the running counters, taken without the lock. Each value is exact on its own,
+    // values updated by concurrent calls may come from slightly different moments.
+    //
+
+    FixedAllocatorStats stats() const {
+        FixedAllocatorStats s = {};
+        s.capacity = container.size();
+        s.freeBytes = counters.freeBytes.load(std::memory_order_relaxed);
+        s.occupiedBytes = s.capacity - std::min(s.freeBytes, s.capacity);
+        s.liveAllocations = counters.liveAllocations.load(std::memory_order_relaxed);
+        s.freeRangeCount = counters.freeRangeCount.load(std::memory_order_relaxed);
+        s.highWaterMark = counters.highWaterMark.load(std::memory_order_relaxed);
+        s.largestFreeBlock = counters.largestFreeBlock.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    void dumpState(std::ostream& out = std::cout) const {
+        typename LockPolicy::SharedLockGuard lockGuard(lock);
+
+        out << ">>> ----------" << std::endl;
+        out << __FUNCTION__ << ":" << std::endl;
+        out << "wholeBuffer={ptr=" << (void*)(container.data()) << ", size=" << container.size() << "}" << std::endl;
+        out << "FreeRanges=[";
+
+        size_type totalFreeSize = 0;
+        freeBufferRanges.forEachRange([&](const range_type& r) {
+            totalFreeSize += r.size;
+            out << "{offset=" << r.offset << ",size=" << r.size << "},";
+        });
+
+        out << "]" << std::endl;
         out << "occupied :" << (container.size() - totalFreeSize) << std::endl;
         out << "available:" << (totalFreeSize) << std::endl;
         out << "<<< ----------" << std::endl;
     }
-    
+
     bool good() const {
         typename LockPolicy::SharedLockGuard lockGuard(lock);
-        
-        auto rangeIt = freeBufferRanges.begin();
-        auto prevRangeIt = freeBufferRanges.end();
-        for (; rangeIt != freeBufferRanges.end(); prevRangeIt = rangeIt++) {
-            auto& r = *rangeIt;
-            
-            if (r.offset >= container.size()) { return false; }
-            if (r.size > container.size()) { return false; }
-            
-            if (prevRangeIt != freeBufferRanges.end()) {
-                auto& pr = *prevRangeIt;
+
+        bool isGood = true;
+        bool hasPrev = false;
+        range_type pr = {};
+        size_t totalFreeSize = 0;
+        size_t freeRangeCount = 0;
+        freeBufferRanges.forEachRange([&](const range_type& r) {
+            if (r.offset >= container.size()) { isGood = false; }
+            if (r.size > container.size()) { isGood = false; }
+
+            if (hasPrev) {
                 auto prEnd = pr.offset + pr.size;
-                
-                if (prEnd >= r.offset) { return false; }
+
+                if (prEnd >= r.offset) { isGood = false; }
             }
-        }
-        
-        return true;
+
+            if constexpr (layout_type::boundaryTags) {
+                if (!isGood || r.size < layout_type::minFragmentSize || r.offset + r.size > container.size()) {
+                    isGood = false;
+                } else {
+                    const uint8_t* headerPtr = container.data() + r.offset;
+                    const uint8_t* footerPtr = headerPtr + r.size - trailerSize;
+                    if (layout_type::tag(headerPtr) != (r.size | layout_type::freeBit)) { isGood = false; }
+                    if (layout_type::tag(footerPtr) != (r.size | layout_type::freeBit)) { isGood = false; }
+                }
+            }
+
+            pr = r;
+            hasPrev = true;
+            totalFreeSize += r.size;
+            ++freeRangeCount;
+        });
+
+        if (totalFreeSize != counters.freeBytes.load(std::memory_order_relaxed)) { isGood = false; }
+        if (freeRangeCount != counters.freeRangeCount.load(std::memory_order_relaxed)) { isGood = false; }
+        if (!sizeRegistry.matches(counters.liveAllocations.load(std::memory_order_relaxed))) { isGood = false; }
+        return isGood;
     }
 };
 
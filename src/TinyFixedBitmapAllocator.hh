@@ -0,0 +1,259 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+
+namespace apemode {
+
+//
+// Small-block front end for a FixedAllocator.
+// The front of the container is split into GranuleSize granules tracked by two bitsets: free granules and the last
+// granule of every allocated run. Requests up to MaxSmallSize bytes (and GranuleSize alignment) take a run of
+// granules from the bitset, without a header or a range entry. Everything else, and small requests that do not fit
+// into the bitset, goes to a FixedAllocator that manages the rest of the container.
+// Runs are found with a shift-and over each 64-bit word (runs may cross into the next word), fully used words are
+// skipped 256 bits at a time with AVX2 when it is available.
+//
+
+template <typename AllocatorType, size_t GranuleSize = 16, size_t MaxSmallSize = 128>
+struct BitmapFixedAllocator {
+    using allocator_type = AllocatorType;
+    using size_type = typename AllocatorType::size_type;
+    using container_type = typename AllocatorType::container_type;
+    using exception_policy = typename AllocatorType::exception_policy;
+    using lock_policy = typename AllocatorType::lock_policy;
+
+    static_assert(GranuleSize >= 1 && !(GranuleSize & (GranuleSize - 1)), "GranuleSize must be a power of two.");
+    static_assert(MaxSmallSize >= GranuleSize && MaxSmallSize <= GranuleSize * 64, "Small runs must fit into 64 granules.");
+    static_assert(std::is_constructible<container_type, uint8_t*, size_t>::value, "Regions are constructed from (data, size).");
+
+    static constexpr size_t bitsPerWord = 64;
+
+    uint8_t* bitmapData = nullptr;
+    size_t granuleCount = 0;
+    std::vector<uint64_t> freeBits{};
+    std::vector<uint64_t> endBits{};
+    size_t firstFreeWordHint = 0;
+    mutable typename lock_policy::Lock bitmapLock{};
+    AllocatorType rangeAllocator;
+
+    //
+    // The first bitmapSize bytes of the container (rounded to whole granules) are served from the bitset.
+    //
+
+    BitmapFixedAllocator(const container_type& c, size_t bitmapSize)
+        : rangeAllocator(splitContainer(c, bitmapSize, bitmapData, granuleCount)) {
+        size_t wordCount = (granuleCount + bitsPerWord - 1) / bitsPerWord;
+#if defined(__AVX2__)
+        wordCount = (wordCount + 3) & ~size_t(3);
+#endif
+        freeBits.assign(wordCount, 0);
+        endBits.assign(wordCount, 0);
+        setBits(freeBits, 0, granuleCount, true);
+    }
+
+    BitmapFixedAllocator(const BitmapFixedAllocator&) = delete;
+    BitmapFixedAllocator& operator=(const BitmapFixedAllocator&) = delete;
+
+    static container_type splitContainer(const container_type& c, size_t bitmapSize, uint8_t*& bitmapData, size_t& granuleCount) {
+        uint8_t* data = c.data();
+        size_t alignPadding = (GranuleSize - (reinterpret_cast<uintptr_t>(data) & (GranuleSize - 1))) & (GranuleSize - 1);
+        size_t regionSize = std::min(c.size(), alignPadding + bitmapSize / GranuleSize * GranuleSize);
+
+        bitmapData = data + alignPadding;
+        granuleCount = regionSize > alignPadding ? (regionSize - alignPadding) / GranuleSize : 0;
+        regionSize = alignPadding + granuleCount * GranuleSize;
+        return container_type(data + regionSize, c.size() - regionSize);
+    }
+
+    static bool isSmall(size_type size, size_type alignment) {
+        return size && size <= MaxSmallSize && alignment <= GranuleSize;
+    }
+
+    bool ownsBitmap(const void* dataPtr) const {
+        auto p = reinterpret_cast<const uint8_t*>(dataPtr);
+        return p >= bitmapData && p < bitmapData + granuleCount * GranuleSize;
+    }
+
+    defaults::ByteSpan allocByteSpanAligned(size_type size, size_type alignment) {
+        if (isSmall(size, alignment)) {
+            size_t runLength = (size + GranuleSize - 1) / GranuleSize;
+
+            typename lock_policy::UniqueLockGuard lockGuard(bitmapLock);
+            size_t granule = findRun(runLength);
+            if (granule != granuleCount) {
+                setBits(freeBits, granule, runLength, false);
+                setBits(endBits, granule + runLength - 1, 1, true);
+                return defaults::ByteSpan(bitmapData + granule * GranuleSize, size);
+            }
+        }
+
+        return rangeAllocator.allocByteSpanAligned(size, alignment);
+    }
+
+    defaults::ByteSpan allocByteSpan(size_type size) { return allocByteSpanAligned(size, 1); }
+    void* alloc(size_type size) { return allocByteSpan(size).data(); }
+    void* allocAligned(size_type size, size_type alignment) { return allocByteSpanAligned(size, alignment).data(); }
+
+    void free(void* dataPtr) noexcept(exception_policy::NoexceptFree) {
+        if (!dataPtr) { return; }
+
+        if (!ownsBitmap(dataPtr)) {
+            rangeAllocator.free(dataPtr);
+            return;
+        }
+
+        if (!freeRun(static_cast<size_t>(reinterpret_cast<uint8_t*>(dataPtr) - bitmapData))) {
+            exception_policy::template raiseError<std::runtime_error>("Memory range is already free.");
+        }
+    }
+
+    void free(void* dataPtr, size_type size) noexcept(exception_policy::NoexceptFree) {
+        if (!dataPtr) { return; }
+
+        if (!ownsBitmap(dataPtr)) {
+            rangeAllocator.free(dataPtr, size);
+            return;
+        }
+
+        free(dataPtr);
+    }
+
+    bool freeRun(size_t offset) {
+        typename lock_policy::UniqueLockGuard lockGuard(bitmapLock);
+
+        size_t granule = offset / GranuleSize;
+        if ((offset & (GranuleSize - 1)) || !isRunStart(granule)) { return false; }
+
+        size_t runEnd = findRunEnd(granule);
+        setBits(endBits, runEnd, 1, false);
+        setBits(freeBits, granule, runEnd + 1 - granule, true);
+        firstFreeWordHint = std::min(firstFreeWordHint, granule / bitsPerWord);
+        return true;
+    }
+
+    size_type allocationSize(const void* dataPtr) const {
+        if (!ownsBitmap(dataPtr)) { return rangeAllocator.allocationSize(dataPtr); }
+
+        typename lock_policy::UniqueLockGuard lockGuard(bitmapLock);
+        size_t granule = static_cast<size_t>(reinterpret_cast<const uint8_t*>(dataPtr) - bitmapData) / GranuleSize;
+        return static_cast<size_type>((findRunEnd(granule) + 1 - granule) * GranuleSize);
+    }
+
+    size_t freeGranuleCount() const {
+        typename lock_policy::UniqueLockGuard lockGuard(bitmapLock);
+
+        size_t count = 0;
+        for (uint64_t word : freeBits) { count += detail::popCount(word); }
+        return count;
+    }
+
+    size_t totalFreeSpace() const {
+        return freeGranuleCount() * GranuleSize + rangeAllocator.totalFreeSpace();
+    }
+
+    //
+    // Bytes managed by both parts, without the padding that aligns the bitset region.
+    //
+
+    size_t capacity() const {
+        return granuleCount * GranuleSize + rangeAllocator.container.size();
+    }
+
+    size_t totalOccupiedSpace() const {
+        return capacity() - totalFreeSpace();
+    }
+
+    bool good() const {
+        {
+            typename lock_policy::UniqueLockGuard lockGuard(bitmapLock);
+            for (size_t w = 0; w < freeBits.size(); ++w) {
+                if (freeBits[w] & endBits[w]) { return false; }
+            }
+        }
+
+        return rangeAllocator.good();
+    }
+
+    //
+    // Bit helpers, the bitmap lock is held by the caller.
+    //
+
+    static void setBits(std::vector<uint64_t>& bits, size_t first, size_t count, bool value) {
+        while (count) {
+            size_t w = first / bitsPerWord;
+            size_t bit = first % bitsPerWord;
+            size_t n = std::min(count, bitsPerWord - bit);
+            uint64_t mask = (n == bitsPerWord ? ~uint64_t(0) : ((uint64_t(1) << n) - 1)) << bit;
+
+            if (value) {
+                bits[w] |= mask;
+            } else {
+                bits[w] &= ~mask;
+            }
+
+            first += n;
+            count -= n;
+        }
+    }
+
+    bool testBit(const std::vector<uint64_t>& bits, size_t i) const {
+        return (bits[i / bitsPerWord] >> (i % bitsPerWord)) & 1;
+    }
+
+    bool isRunStart(size_t granule) const {
+        if (granule >= granuleCount || testBit(freeBits, granule)) { return false; }
+        return granule == 0 || testBit(freeBits, granule - 1) || testBit(endBits, granule - 1);
+    }
+
+    size_t findRunEnd(size_t granule) const {
+        size_t w = granule / bitsPerWord;
+        uint64_t word = endBits[w] & (~uint64_t(0) << (granule % bitsPerWord));
+        while (!word) { word = endBits[++w]; }
+        return w * bitsPerWord + detail::findFirstSet(word);
+    }
+
+    size_t nextNonEmptyWord(size_t w) const {
+#if defined(__AVX2__)
+        while (w & 3) {
+            if (freeBits[w]) { return w; }
+            ++w;
+        }
+
+        for (; w < freeBits.size(); w += 4) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(freeBits.data() + w));
+            if (!_mm256_testz_si256(v, v)) { break; }
+        }
+#endif
+        while (w < freeBits.size() && !freeBits[w]) { ++w; }
+        return w;
+    }
+
+    //
+    // Returns the first granule of the lowest run of free granules, or granuleCount.
+    //
+
+    size_t findRun(size_t runLength) {
+        size_t w = nextNonEmptyWord(firstFreeWordHint);
+        firstFreeWordHint = w;
+
+        for (; w < freeBits.size(); w = nextNonEmptyWord(w + 1)) {
+            uint64_t word = freeBits[w];
+            uint64_t nextWord = w + 1 < freeBits.size() ? freeBits[w + 1] : 0;
+
+            //
+            // A bit stays set if the run starting there is at least runLength granules long.
+            //
+
+            uint64_t starts = word;
+            for (size_t k = 1; k < runLength && starts; ++k) {
+                starts &= (word >> k) | (nextWord << (bitsPerWord - k));
+            }
+
+            if (starts) { return w * bitsPerWord + detail::findFirstSet(starts); }
+        }
+
+        return granuleCount;
+    }
+};
+
+}
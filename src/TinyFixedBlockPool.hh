@@ -0,0 +1,115 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+#include <cstddef>
+
+namespace apemode {
+
+//
+// Lock-free pool of equally sized blocks carved out of a ByteSpan, for example a chunk returned by
+// FixedAllocator::allocByteSpanAligned. The pool does not own the memory.
+// Free blocks form a stack linked through their first four bytes, there is no per-block header.
+// The stack head packs the top block index with a generation counter that changes on every push and pop,
+// so a stale compare-exchange cannot succeed after the same block was popped and pushed again (ABA).
+// Double frees are not detected.
+//
+
+template <size_t BlockSize,
+          size_t BlockAlignment = alignof(std::max_align_t),
+          typename ExceptionPolicy = defaults::DefaultExceptionPolicy>
+struct FixedBlockPool {
+    static_assert(BlockSize >= sizeof(uint32_t), "Free blocks store the next block index.");
+    static_assert(BlockAlignment >= alignof(uint32_t) && !(BlockAlignment & (BlockAlignment - 1)), "Invalid block alignment.");
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free, "Lock-free 32-bit atomics are required.");
+
+    static constexpr size_t blockStride = (BlockSize + BlockAlignment - 1) & ~(BlockAlignment - 1);
+
+    //
+    // Block indices are stored off by one, so that zero terminates the stack.
+    //
+
+    static constexpr uint32_t nullLink = 0;
+
+    uint8_t* blocksPtr = nullptr;
+    uint32_t blockCount = 0;
+    std::atomic<uint64_t> head = {0};
+
+    explicit FixedBlockPool(defaults::ByteSpan span) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(span.data());
+        size_t padding = (BlockAlignment - (address & (BlockAlignment - 1))) & (BlockAlignment - 1);
+        if (span.empty() || span.size() < padding) { return; }
+
+        size_t count = (span.size() - padding) / blockStride;
+        assert(count < std::numeric_limits<uint32_t>::max());
+
+        blocksPtr = span.data() + padding;
+        blockCount = static_cast<uint32_t>(count);
+
+        for (uint32_t i = 0; i < blockCount; ++i) {
+            nextLink(i).store(i + 1 < blockCount ? i + 2 : nullLink, std::memory_order_relaxed);
+        }
+
+        head.store(pack(blockCount ? 1 : nullLink, 0), std::memory_order_release);
+    }
+
+    FixedBlockPool(const FixedBlockPool&) = delete;
+    FixedBlockPool& operator=(const FixedBlockPool&) = delete;
+
+    static uint64_t pack(uint32_t link, uint32_t generation) { return (uint64_t(generation) << 32) | link; }
+    static uint32_t linkOf(uint64_t h) { return static_cast<uint32_t>(h); }
+    static uint32_t generationOf(uint64_t h) { return static_cast<uint32_t>(h >> 32); }
+
+    uint8_t* blockPtr(uint32_t i) const { return blocksPtr + size_t(i) * blockStride; }
+
+    std::atomic<uint32_t>& nextLink(uint32_t i) const {
+        return *reinterpret_cast<std::atomic<uint32_t>*>(blockPtr(i));
+    }
+
+    void* alloc() {
+        uint64_t h = head.load(std::memory_order_acquire);
+        while (linkOf(h) != nullLink) {
+            uint32_t i = linkOf(h) - 1;
+
+            //
+            // The block may be popped and reused by another thread meanwhile, the read value is then
+            // discarded because the generation no longer matches.
+            //
+
+            uint32_t next = nextLink(i).load(std::memory_order_relaxed);
+            if (head.compare_exchange_weak(h, pack(next, generationOf(h) + 1), std::memory_order_acquire, std::memory_order_acquire)) {
+                return blockPtr(i);
+            }
+        }
+
+        return nullptr;
+    }
+
+    void free(void* dataPtr) noexcept(ExceptionPolicy::NoexceptFree) {
+        if (!dataPtr) { return; }
+
+        uint8_t* p = reinterpret_cast<uint8_t*>(dataPtr);
+        if (p < blocksPtr || p >= blockPtr(blockCount)) {
+            ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is out of bounds.");
+        }
+
+        size_t offset = static_cast<size_t>(p - blocksPtr);
+        if (offset % blockStride) {
+            ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is not a pool block.");
+        }
+
+        uint32_t i = static_cast<uint32_t>(offset / blockStride);
+        uint64_t h = head.load(std::memory_order_relaxed);
+        do {
+            nextLink(i).store(linkOf(h), std::memory_order_relaxed);
+        } while (!head.compare_exchange_weak(h, pack(i + 1, generationOf(h) + 1), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    bool owns(const void* dataPtr) const {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(dataPtr);
+        return p >= blocksPtr && p < blockPtr(blockCount);
+    }
+
+    size_t capacity() const { return blockCount; }
+};
+
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+#include <chrono>
+#include <map>
+
+namespace apemode {
+
+//
+// Stable name of a relocatable block. Generation 0 is the null handle, a freed slot bumps its generation so stale
+// handles are detected.
+//
+
+struct FixedAllocatorHandle {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+
+    bool valid() const { return generation != 0; }
+    bool operator==(const FixedAllocatorHandle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const FixedAllocatorHandle& other) const { return !(*this == other); }
+};
+
+//
+// Handle-based allocations over a FixedAllocator, for long-running arenas that fragment over time.
+// Callers keep handles and resolve them to addresses through the handle table. compactStep() slides unpinned blocks
+// down into the free range right before them, so repeated passes merge the free ranges into one tail range.
+// An address from resolve() stays valid until the next compaction step, pin() keeps the block in place until unpin().
+// The allocator may serve raw allocations at the same time, those blocks are never moved.
+//
+
+template <typename AllocatorType>
+struct HandleFixedAllocator {
+    using allocator_type = AllocatorType;
+    using size_type = typename AllocatorType::size_type;
+    using exception_policy = typename AllocatorType::exception_policy;
+    using lock_policy = typename AllocatorType::lock_policy;
+    using clock_type = std::chrono::steady_clock;
+
+    static_assert(!AllocatorType::layout_type::headerless, "Headerless blocks cannot be moved.");
+
+    struct HandleEntry {
+        uint8_t* dataPtr = nullptr;
+        uint32_t generation = 1;
+        uint32_t pins = 0;
+        uint32_t nextFree = 0;
+    };
+
+    static constexpr uint32_t nullIndex = ~uint32_t(0);
+
+    AllocatorType* allocator = nullptr;
+    std::vector<HandleEntry> entries{};
+    std::map<uint8_t*, uint32_t> addressToEntry{};
+    uint32_t freeEntry = nullIndex;
+    uint8_t* compactCursor = nullptr;
+    mutable typename lock_policy::Lock tableLock{};
+
+    explicit HandleFixedAllocator(AllocatorType& a) : allocator(&a) {}
+
+    HandleFixedAllocator(const HandleFixedAllocator&) = delete;
+    HandleFixedAllocator& operator=(const HandleFixedAllocator&) = delete;
+
+    FixedAllocatorHandle allocHandle(size_type size) {
+        void* dataPtr = allocator->alloc(size);
+        if (!dataPtr) { return {}; }
+
+        typename lock_policy::UniqueLockGuard lockGuard(tableLock);
+
+        uint32_t index = freeEntry;
+        if (index != nullIndex) {
+            freeEntry = entries[index].nextFree;
+        } else {
+            index = static_cast<uint32_t>(entries.size());
+            entries.emplace_back();
+        }
+
+        HandleEntry& entry = entries[index];
+        entry.dataPtr = static_cast<uint8_t*>(dataPtr);
+        entry.pins = 0;
+        entry.nextFree = nullIndex;
+        addressToEntry.emplace(entry.dataPtr, index);
+        return {index, entry.generation};
+    }
+
+    void freeHandle(FixedAllocatorHandle handle) {
+        uint8_t* dataPtr = nullptr;
+        {
+            typename lock_policy::UniqueLockGuard lockGuard(tableLock);
+
+            HandleEntry* entry = find(handle);
+            if (!entry) {
+                exception_policy::template raiseError<std::runtime_error>("Stale or invalid handle.");
+                return;
+            }
+
+            if (entry->pins) {
+                exception_policy::template raiseError<std::runtime_error>("Pinned handles cannot be freed.");
+                return;
+            }
+
+            dataPtr = entry->dataPtr;
+            addressToEntry.erase(dataPtr);
+
+            //
+            // Skip generation 0 on wrap-around, it marks the null handle.
+            //
+
+            entry->dataPtr = nullptr;
+            entry->generation = entry->generation + 1 ? entry->generation + 1 : 1;
+            entry->nextFree = freeEntry;
+            freeEntry = handle.index;
+        }
+
+        allocator->free(dataPtr);
+    }
+
+    //
+    // Current address of the block, or nullptr for a stale handle.
+    //
+
+    void* resolve(FixedAllocatorHandle handle) const {
+        typename lock_policy::SharedLockGuard lockGuard(tableLock);
+        const HandleEntry* entry = find(handle);
+        return entry ? entry->dataPtr : nullptr;
+    }
+
+    void* pin(FixedAllocatorHandle handle) {
+        typename lock_policy::UniqueLockGuard lockGuard(tableLock);
+
+        HandleEntry* entry = find(handle);
+        if (!entry) { return nullptr; }
+
+        ++entry->pins;
+        return entry->dataPtr;
+    }
+
+    void unpin(FixedAllocatorHandle handle) {
+        typename lock_policy::UniqueLockGuard lockGuard(tableLock);
+
+        HandleEntry* entry = find(handle);
+        assert(entry && entry->pins);
+        if (entry && entry->pins) { --entry->pins; }
+    }
+
+    //
+    // Moves blocks in address order, resuming where the previous step stopped, until the budget runs out or the
+    // pass reaches the end of the arena. The table lock is taken per block, so allocHandle(), resolve() and pin()
+    // wait for one block move at most. Returns the number of moved blocks.
+    //
+
+    size_t compactStep(std::chrono::nanoseconds budget) {
+        const auto startTime = clock_type::now();
+
+        size_t movedBlocks = 0;
+        while (clock_type::now() - startTime < budget) {
+            typename lock_policy::UniqueLockGuard lockGuard(tableLock);
+
+            auto entryIt = addressToEntry.lower_bound(compactCursor);
+            if (entryIt == addressToEntry.end()) {
+                compactCursor = nullptr;
+                break;
+            }
+
+            HandleEntry& entry = entries[entryIt->second];
+            compactCursor = entry.dataPtr + 1;
+            if (entry.pins) { continue; }
+
+            auto movedPtr = static_cast<uint8_t*>(allocator->slideDown(entry.dataPtr));
+            if (!movedPtr) { continue; }
+
+            //
+            // The block moves into the gap before it, so it keeps its place in the address order.
+            //
+
+            auto hintIt = addressToEntry.erase(entryIt);
+            addressToEntry.emplace_hint(hintIt, movedPtr, static_cast<uint32_t>(&entry - entries.data()));
+            entry.dataPtr = movedPtr;
+            compactCursor = movedPtr + 1;
+            ++movedBlocks;
+        }
+
+        return movedBlocks;
+    }
+
+    //
+    // Full passes until nothing moves.
+    //
+
+    size_t compact() {
+        compactCursor = nullptr;
+
+        size_t movedBlocks = 0;
+        for (;;) {
+            size_t moved = compactStep(std::chrono::nanoseconds::max());
+            movedBlocks += moved;
+            if (!moved) { break; }
+        }
+
+        return movedBlocks;
+    }
+
+    size_t size() const {
+        typename lock_policy::SharedLockGuard lockGuard(tableLock);
+        return addressToEntry.size();
+    }
+
+    HandleEntry* find(FixedAllocatorHandle handle) {
+        if (handle.index >= entries.size()) { return nullptr; }
+
+        HandleEntry& entry = entries[handle.index];
+        return entry.generation == handle.generation && entry.dataPtr ? &entry : nullptr;
+    }
+
+    const HandleEntry* find(FixedAllocatorHandle handle) const {
+        return const_cast<HandleFixedAllocator*>(this)->find(handle);
+    }
+};
+
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+#include <chrono>
+#include <string>
+
+namespace apemode {
+
+//
+// Power-of-two histogram, bucket k counts values in [2^(k-1), 2^k - 1], bucket 0 counts zeros.
+//
+
+struct FixedAllocatorHistogram {
+    static constexpr uint32_t bucketCount = 40;
+
+    uint64_t buckets[bucketCount] = {};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    static uint32_t bucketOf(uint64_t value) {
+        return value ? std::min(detail::findLastSet(value) + 1, bucketCount - 1) : 0;
+    }
+
+    static uint64_t upperBound(uint32_t bucket) {
+        return bucket ? (uint64_t(1) << bucket) - 1 : 0;
+    }
+};
+
+//
+// Snapshot of an instrumentation policy, plain values that can be compared or exported.
+//
+
+struct FixedAllocatorInstrumentationSnapshot {
+    FixedAllocatorHistogram allocSizes{};
+    FixedAllocatorHistogram freeSizes{};
+    FixedAllocatorHistogram probes{};
+    FixedAllocatorHistogram lockWaitNs{};
+    FixedAllocatorHistogram allocLatencyNs{};
+    FixedAllocatorHistogram freeLatencyNs{};
+    uint64_t failedAllocs = 0;
+};
+
+namespace defaults {
+
+//
+// Counts every alloc and free per power-of-two size class, failed allocations and the number of free ranges
+// the fit policy examined. Lock waits and call latencies are timed for one call in SampleRate per thread.
+// Counters are relaxed atomics, snapshot() may run concurrently with the allocator.
+//
+
+template <uint32_t SampleRate = 64>
+struct HistogramInstrumentationPolicy {
+    static_assert(SampleRate > 0, "SampleRate must be positive.");
+
+    static constexpr bool enabled = true;
+    static constexpr uint32_t bucketCount = FixedAllocatorHistogram::bucketCount;
+
+    struct AtomicHistogram {
+        std::atomic<uint64_t> buckets[bucketCount] = {};
+        std::atomic<uint64_t> count = {0};
+        std::atomic<uint64_t> sum = {0};
+
+        void record(uint64_t value) {
+            buckets[FixedAllocatorHistogram::bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        void load(FixedAllocatorHistogram& histogram) const {
+            for (uint32_t i = 0; i < bucketCount; ++i) { histogram.buckets[i] = buckets[i].load(std::memory_order_relaxed); }
+            histogram.count = count.load(std::memory_order_relaxed);
+            histogram.sum = sum.load(std::memory_order_relaxed);
+        }
+    };
+
+    AtomicHistogram allocSizes{};
+    AtomicHistogram freeSizes{};
+    AtomicHistogram probes{};
+    AtomicHistogram lockWaitNs{};
+    AtomicHistogram allocLatencyNs{};
+    AtomicHistogram freeLatencyNs{};
+    std::atomic<uint64_t> failedAllocs = {0};
+
+    static bool sample() {
+        static thread_local uint32_t callCounter = 0;
+        return callCounter++ % SampleRate == 0;
+    }
+
+    static uint64_t now() {
+        auto sinceEpoch = std::chrono::steady_clock::now().time_since_epoch();
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count());
+    }
+
+    void onLockWait(uint64_t ns) { lockWaitNs.record(ns); }
+    void onAllocLatency(uint64_t ns) { allocLatencyNs.record(ns); }
+    void onFreeLatency(uint64_t ns) { freeLatencyNs.record(ns); }
+    void onFree(size_t size) { freeSizes.record(size); }
+
+    void onAlloc(size_t size, bool succeeded, size_t probeCount) {
+        probes.record(probeCount);
+        if (succeeded) {
+            allocSizes.record(size);
+        } else {
+            failedAllocs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    FixedAllocatorInstrumentationSnapshot snapshot() const {
+        FixedAllocatorInstrumentationSnapshot s = {};
+        allocSizes.load(s.allocSizes);
+        freeSizes.load(s.freeSizes);
+        probes.load(s.probes);
+        lockWaitNs.load(s.lockWaitNs);
+        allocLatencyNs.load(s.allocLatencyNs);
+        freeLatencyNs.load(s.freeLatencyNs);
+        s.failedAllocs = failedAllocs.load(std::memory_order_relaxed);
+        return s;
+    }
+};
+}
+
+//
+// Plain-text metrics export (Prometheus text exposition format).
+// Histograms are cumulative with an upper bound label per power-of-two bucket, empty trailing buckets are skipped.
+//
+
+inline void exportHistogram(std::ostream& out, const std::string& name, const FixedAllocatorHistogram& histogram) {
+    uint32_t lastBucket = 0;
+    for (uint32_t i = 0; i < FixedAllocatorHistogram::bucketCount; ++i) {
+        if (histogram.buckets[i]) { lastBucket = i; }
+    }
+
+    out << "# TYPE " << name << " histogram\n";
+
+    uint64_t cumulativeCount = 0;
+    for (uint32_t i = 0; i <= lastBucket; ++i) {
+        cumulativeCount += histogram.buckets[i];
+        out << name << "_bucket{le=\"" << FixedAllocatorHistogram::upperBound(i) << "\"} " << cumulativeCount << "\n";
+    }
+
+    out << name << "_bucket{le=\"+Inf\"} " << histogram.count << "\n";
+    out << name << "_sum " << histogram.sum << "\n";
+    out << name << "_count " << histogram.count << "\n";
+}
+
+inline void exportStats(std::ostream& out, const std::string& prefix, const FixedAllocatorStats& stats) {
+    auto gauge = [&](const char* name, double value) {
+        out << "# TYPE " << prefix << "_" << name << " gauge\n";
+        out << prefix << "_" << name << " " << value << "\n";
+    };
+
+    gauge("capacity_bytes", double(stats.capacity));
+    gauge("free_bytes", double(stats.freeBytes));
+    gauge("occupied_bytes", double(stats.occupiedBytes));
+    gauge("high_water_mark_bytes", double(stats.highWaterMark));
+    gauge("largest_free_block_bytes", double(stats.largestFreeBlock));
+    gauge("live_allocations", double(stats.liveAllocations));
+    gauge("free_ranges", double(stats.freeRangeCount));
+    gauge("fragmentation", stats.fragmentation());
+}
+
+inline void exportInstrumentation(std::ostream& out, const std::string& prefix, const FixedAllocatorInstrumentationSnapshot& s) {
+    out << "# TYPE " << prefix << "_failed_allocs_total counter\n";
+    out << prefix << "_failed_allocs_total " << s.failedAllocs << "\n";
+
+    exportHistogram(out, prefix + "_alloc_size_bytes", s.allocSizes);
+    exportHistogram(out, prefix + "_free_size_bytes", s.freeSizes);
+    exportHistogram(out, prefix + "_fit_probes", s.probes);
+    exportHistogram(out, prefix + "_lock_wait_ns", s.lockWaitNs);
+    exportHistogram(out, prefix + "_alloc_latency_ns", s.allocLatencyNs);
+    exportHistogram(out, prefix + "_free_latency_ns", s.freeLatencyNs);
+}
+
+//
+// Exports the running statistics of the allocator, and its instrumentation if it has any.
+//
+
+template <typename AllocatorType>
+void exportMetrics(std::ostream& out, const AllocatorType& allocator, const std::string& prefix = "tiny_fixed_allocator") {
+    exportStats(out, prefix, allocator.stats());
+
+    if constexpr (AllocatorType::instrumentation_type::enabled) {
+        exportInstrumentation(out, prefix, allocator.instrumentation.snapshot());
+    }
+}
+
+}
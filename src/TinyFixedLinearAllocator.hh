@@ -0,0 +1,135 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+
+namespace apemode {
+
+//
+// Position of the bump pointer, taken by mark() and restored by rewind().
+//
+
+template <typename SizeType>
+struct LinearAllocatorMarker {
+    SizeType offset = 0;
+};
+
+//
+// Bump-pointer allocator over a container, for data that dies together (per request, per frame).
+// Blocks carry no header and are never coalesced: alloc() moves the top, rewind() drops everything allocated after
+// a marker and reset() drops everything in O(1). A sized free() of the topmost block pops it (stack order), other
+// frees are no-ops that wait for the next rewind() or reset().
+// There is no lock, a linear allocator belongs to one thread.
+//
+
+template <typename SizeType, typename ContainerType = defaults::ByteSpan, typename ExceptionPolicy = defaults::DefaultExceptionPolicy>
+struct LinearFixedAllocator {
+    using size_type = SizeType;
+    using container_type = ContainerType;
+    using exception_policy = ExceptionPolicy;
+    using marker_type = LinearAllocatorMarker<SizeType>;
+
+    ContainerType container{};
+    size_type top = 0;
+    size_type highWaterMark = 0;
+
+    LinearFixedAllocator() = default;
+
+    explicit LinearFixedAllocator(const ContainerType& c) : container(c) {
+        assert(container.size() <= std::numeric_limits<size_type>::max());
+    }
+
+    //
+    // Alignment must be a power of two, it is applied to the address rather than to the offset.
+    //
+
+    defaults::ByteSpan allocByteSpanAligned(size_type size, size_type alignment) {
+        if (!alignment || (alignment & (alignment - 1))) { assert(false); return {}; }
+
+        uintptr_t topPtr = reinterpret_cast<uintptr_t>(container.data()) + top;
+        uintptr_t alignedPtr = (topPtr + alignment - 1) & ~uintptr_t(alignment - 1);
+        size_t offset = top + static_cast<size_t>(alignedPtr - topPtr);
+        if (!container.data() || offset + size > container.size()) { return {}; }
+
+        top = static_cast<size_type>(offset + size);
+        highWaterMark = std::max(highWaterMark, top);
+        return defaults::ByteSpan(container.data() + offset, size);
+    }
+
+    defaults::ByteSpan allocByteSpan(size_type size) { return allocByteSpanAligned(size, 1); }
+    void* alloc(size_type size) { return allocByteSpan(size).data(); }
+    void* allocAligned(size_type size, size_type alignment) { return allocByteSpanAligned(size, alignment).data(); }
+
+    void free(void* dataPtr) noexcept(ExceptionPolicy::NoexceptFree) {
+        if (dataPtr && !owns(dataPtr)) { ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is out of bounds."); }
+    }
+
+    void free(void* dataPtr, size_type size) noexcept(ExceptionPolicy::NoexceptFree) {
+        if (!dataPtr) { return; }
+        if (!owns(dataPtr)) {
+            ExceptionPolicy::template raiseError<std::runtime_error>("Memory range is out of bounds.");
+            return;
+        }
+
+        size_type offset = static_cast<size_type>(reinterpret_cast<uint8_t*>(dataPtr) - container.data());
+        if (offset + size == top) { top = offset; }
+    }
+
+    marker_type mark() const { return {top}; }
+
+    void rewind(marker_type marker) {
+        assert(marker.offset <= top);
+        top = std::min(top, marker.offset);
+    }
+
+    void reset() { top = 0; }
+
+    //
+    // A zero-size block starts right at the top, so the top address is owned as well.
+    //
+
+    bool owns(const void* dataPtr) const {
+        auto p = reinterpret_cast<const uint8_t*>(dataPtr);
+        return p >= container.data() && p <= container.data() + top;
+    }
+
+    size_type totalOccupiedSpace() const { return top; }
+    size_type totalFreeSpace() const { return static_cast<size_type>(container.size() - top); }
+    bool good() const { return top <= container.size(); }
+};
+
+//
+// Scoped marker: everything allocated from the linear allocator during the scope is dropped at its end.
+//
+
+template <typename LinearAllocatorType>
+struct LinearAllocatorScope {
+    LinearAllocatorType& allocator;
+    typename LinearAllocatorType::marker_type marker{};
+
+    explicit LinearAllocatorScope(LinearAllocatorType& a) : allocator(a), marker(a.mark()) {}
+    ~LinearAllocatorScope() { allocator.rewind(marker); }
+
+    LinearAllocatorScope(const LinearAllocatorScope&) = delete;
+    LinearAllocatorScope& operator=(const LinearAllocatorScope&) = delete;
+};
+
+//
+// Linear frame carved out of one block of a regular allocator (FixedAllocator, ShardedFixedAllocator, ...) and
+// returned to it on destruction. A frame that could not get its block is empty and every allocation fails.
+//
+
+template <typename AllocatorType>
+struct FixedAllocatorFrame : LinearFixedAllocator<typename AllocatorType::size_type, defaults::ByteSpan, typename AllocatorType::exception_policy> {
+    using base_type = LinearFixedAllocator<typename AllocatorType::size_type, defaults::ByteSpan, typename AllocatorType::exception_policy>;
+    using size_type = typename AllocatorType::size_type;
+
+    AllocatorType* parent = nullptr;
+
+    FixedAllocatorFrame(AllocatorType& a, size_type size) : base_type(a.allocByteSpan(size)), parent(&a) {}
+    ~FixedAllocatorFrame() { parent->free(this->container.data(), static_cast<size_type>(this->container.size())); }
+
+    FixedAllocatorFrame(const FixedAllocatorFrame&) = delete;
+    FixedAllocatorFrame& operator=(const FixedAllocatorFrame&) = delete;
+};
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+#include <new>
+
+#if defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define APEMODE_FIXED_ALLOCATOR_HAS_PMR 1
+#endif
+#endif
+
+namespace apemode {
+
+namespace detail {
+
+//
+// Allocation for STL callers: size and alignment are checked against size_type, zero-sized requests take one byte,
+// and failures throw std::bad_alloc whatever the exception policy of the allocator is.
+//
+
+template <typename AllocatorType>
+void* allocateOrThrow(AllocatorType& allocator, size_t bytes, size_t alignment) {
+    using size_type = typename AllocatorType::size_type;
+
+    if (bytes > std::numeric_limits<size_type>::max() || alignment > std::numeric_limits<size_type>::max()) {
+        throw std::bad_alloc();
+    }
+
+    void* dataPtr = allocator.allocAligned(static_cast<size_type>(bytes ? bytes : 1), static_cast<size_type>(alignment));
+    if (!dataPtr) { throw std::bad_alloc(); }
+    return dataPtr;
+}
+}
+
+//
+// Stateful STL allocator over any allocator with allocAligned() and a sized free() (FixedAllocator with any lock
+// policy and block format, ShardedFixedAllocator, BitmapFixedAllocator). Copies and rebinds share the same allocator
+// and compare equal, so containers may move and swap their storage.
+//
+
+template <typename T, typename AllocatorType>
+struct FixedStlAllocator {
+    using value_type = T;
+    using allocator_type = AllocatorType;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <typename U>
+    struct rebind {
+        using other = FixedStlAllocator<U, AllocatorType>;
+    };
+
+    AllocatorType* allocator = nullptr;
+
+    explicit FixedStlAllocator(AllocatorType& a) noexcept : allocator(&a) {}
+
+    template <typename U>
+    FixedStlAllocator(const FixedStlAllocator<U, AllocatorType>& other) noexcept : allocator(other.allocator) {}
+
+    T* allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) { throw std::bad_alloc(); }
+        return static_cast<T*>(detail::allocateOrThrow(*allocator, n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* dataPtr, size_t n) noexcept {
+        allocator->free(dataPtr, static_cast<typename AllocatorType::size_type>(n * sizeof(T)));
+    }
+
+    template <typename U>
+    bool operator==(const FixedStlAllocator<U, AllocatorType>& other) const noexcept { return allocator == other.allocator; }
+
+    template <typename U>
+    bool operator!=(const FixedStlAllocator<U, AllocatorType>& other) const noexcept { return allocator != other.allocator; }
+};
+
+#if defined(APEMODE_FIXED_ALLOCATOR_HAS_PMR)
+
+//
+// std::pmr::memory_resource over the same allocators, for pmr containers and strings.
+// do_allocate() honors the requested alignment, do_deallocate() frees with the passed size, so headerless allocators
+// work as well. Resources are equal only if they draw from the same allocator.
+//
+
+template <typename AllocatorType>
+struct FixedAllocatorResource : std::pmr::memory_resource {
+    AllocatorType* allocator = nullptr;
+
+    explicit FixedAllocatorResource(AllocatorType& a) noexcept : allocator(&a) {}
+
+    AllocatorType& underlying() const noexcept { return *allocator; }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        return detail::allocateOrThrow(*allocator, bytes, alignment);
+    }
+
+    void do_deallocate(void* dataPtr, size_t bytes, size_t alignment) override {
+        (void)alignment;
+        allocator->free(dataPtr, static_cast<typename AllocatorType::size_type>(bytes ? bytes : 1));
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        if (this == &other) { return true; }
+
+        auto otherResource = dynamic_cast<const FixedAllocatorResource*>(&other);
+        return otherResource && otherResource->allocator == allocator;
+    }
+};
+
+#endif
+
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+#include <cstring>
+#include <thread>
+
+namespace apemode {
+
+//
+// Ownership-aware front end for a FixedAllocator shared by a pipeline: one thread allocates, others free.
+// Frees from the owning thread go straight to the allocator. Frees from other threads are pushed onto a lock-free
+// return queue (an intrusive list threaded through the freed payloads), a single CAS that never touches the
+// allocator lock. The owner drains the queue on its next allocation, and a remote free that brings the queue to
+// DrainThreshold blocks only raises a flag, so the owner also drains on its next free. Remote threads never take
+// the allocator lock, and the owner is the only consumer of the queue.
+// A drain takes the whole list with one exchange and returns it through freeBatch(), which sorts the ranges and
+// coalesces them in one pass under one lock acquisition.
+// Payloads are at least pointer sized, so blocks freed here must come from this front end.
+//
+
+template <typename AllocatorType, size_t DrainThreshold = 256>
+struct OwnedFixedAllocator {
+    using allocator_type = AllocatorType;
+    using size_type = typename AllocatorType::size_type;
+    using exception_policy = typename AllocatorType::exception_policy;
+
+    static_assert(!AllocatorType::layout_type::headerless, "Headerless blocks cannot be returned in batches.");
+    static_assert(DrainThreshold > 0, "DrainThreshold must be positive.");
+
+    static constexpr size_t drainBatchSize = 64;
+    static constexpr size_type minPayloadSize = sizeof(void*);
+
+    AllocatorType* allocator = nullptr;
+    std::atomic<std::thread::id> owner{};
+    std::atomic<void*> returnHead = {nullptr};
+    std::atomic<size_t> returnCount = {0};
+    std::atomic<bool> drainRequested = {false};
+
+    explicit OwnedFixedAllocator(AllocatorType& a) : allocator(&a), owner(std::this_thread::get_id()) {}
+
+    OwnedFixedAllocator(const OwnedFixedAllocator&) = delete;
+    OwnedFixedAllocator& operator=(const OwnedFixedAllocator&) = delete;
+    ~OwnedFixedAllocator() { drainQueue(); }
+
+    //
+    // Makes the calling thread the owner, e.g. when a pipeline stage migrates.
+    //
+
+    void adopt() { owner.store(std::this_thread::get_id(), std::memory_order_relaxed); }
+    bool isOwner() const { return std::this_thread::get_id() == owner.load(std::memory_order_relaxed); }
+
+    defaults::ByteSpan allocByteSpanAligned(size_type size, size_type alignment) {
+        if (returnHead.load(std::memory_order_relaxed)) { drainQueue(); }
+
+        auto allocatedSpan = allocator->allocByteSpanAligned(std::max(size, minPayloadSize), alignment);
+        return allocatedSpan.data() ? defaults::ByteSpan(allocatedSpan.data(), size) : defaults::ByteSpan{};
+    }
+
+    defaults::ByteSpan allocByteSpan(size_type size) { return allocByteSpanAligned(size, 1); }
+    void* alloc(size_type size) { return allocByteSpan(size).data(); }
+    void* allocAligned(size_type size, size_type alignment) { return allocByteSpanAligned(size, alignment).data(); }
+
+    void free(void* dataPtr) noexcept(exception_policy::NoexceptFree) {
+        if (!dataPtr) { return; }
+
+        if (isOwner()) {
+            allocator->free(dataPtr);
+            if (drainRequested.load(std::memory_order_relaxed)) { drainQueue(); }
+            return;
+        }
+
+        assert(allocator->allocationSize(dataPtr) >= minPayloadSize);
+
+        //
+        // Counted before the push, so a concurrent drain never takes the count below zero.
+        // Payloads are not aligned for pointers, the link is copied in and out.
+        //
+
+        size_t queuedCount = returnCount.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        void* head = returnHead.load(std::memory_order_relaxed);
+        do {
+            std::memcpy(dataPtr, &head, sizeof(head));
+        } while (!returnHead.compare_exchange_weak(head, dataPtr, std::memory_order_release, std::memory_order_relaxed));
+
+        if (queuedCount >= DrainThreshold) { drainRequested.store(true, std::memory_order_relaxed); }
+    }
+
+    void free(void* dataPtr, size_type) noexcept(exception_policy::NoexceptFree) { free(dataPtr); }
+
+    size_type allocationSize(const void* dataPtr) const { return allocator->allocationSize(dataPtr); }
+
+    //
+    // Returns every queued block to the allocator, called by the owner only.
+    //
+
+    size_t drain() noexcept(exception_policy::NoexceptFree) {
+        assert(isOwner());
+        return drainQueue();
+    }
+
+    //
+    // Taking the whole list at once leaves no room for ABA. The flag is cleared first,
+    // so a remote free that reaches the threshold during the drain raises it again.
+    //
+
+    size_t drainQueue() noexcept(exception_policy::NoexceptFree) {
+        drainRequested.store(false, std::memory_order_relaxed);
+        void* node = returnHead.exchange(nullptr, std::memory_order_acquire);
+
+        void* batch[drainBatchSize];
+        size_t batchCount = 0;
+        size_t drainedCount = 0;
+
+        while (node) {
+            batch[batchCount++] = node;
+            std::memcpy(&node, node, sizeof(node));
+
+            if (batchCount == drainBatchSize || !node) {
+                allocator->freeBatch(batch, batchCount);
+                drainedCount += batchCount;
+                batchCount = 0;
+            }
+        }
+
+        if (drainedCount) { returnCount.fetch_sub(drainedCount, std::memory_order_relaxed); }
+        return drainedCount;
+    }
+
+    //
+    // Queued blocks count as occupied space of the allocator until they are drained.
+    //
+
+    size_t pendingFrees() const { return returnCount.load(std::memory_order_relaxed); }
+    size_type totalFreeSpace() const { return allocator->totalFreeSpace(); }
+    size_type totalOccupiedSpace() const { return allocator->totalOccupiedSpace(); }
+    bool good() const { return allocator->good(); }
+};
+
+}
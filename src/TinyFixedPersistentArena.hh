@@ -0,0 +1,255 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+#include <memory>
+#include <new>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define APEMODE_FIXED_ALLOCATOR_HAS_MMAP 1
+#endif
+
+namespace apemode {
+
+//
+// File layout of a persistent arena: the header, the free range table, then the heap (page aligned).
+// Everything is stored as offsets, nothing in the file depends on the address it is mapped at.
+// The table is written on clean shutdown only. While the arena is open cleanShutdown stays 0, so a crash is
+// noticed on the next open.
+//
+
+struct PersistentArenaRange {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+struct PersistentArenaHeader {
+    static constexpr uint64_t magicValue = 0x414e455241584946ull; // "FIXARENA"
+    static constexpr uint32_t currentVersion = 1;
+    static constexpr uint64_t nullOffset = ~uint64_t(0);
+
+    uint64_t magic = magicValue;
+    uint32_t version = currentVersion;
+    uint32_t layoutId = 0;
+    uint64_t heapOffset = 0;
+    uint64_t heapSize = 0;
+    uint64_t rangeCapacity = 0;
+    uint64_t rangeCount = 0;
+    uint64_t rootOffset = nullOffset;
+    uint32_t cleanShutdown = 0;
+    uint32_t reserved = 0;
+};
+
+enum class PersistentArenaState {
+    Created,   // New file.
+    Restored,  // Clean shutdown, free ranges taken from the table.
+    Recovered, // Crash or overflowing table, free ranges rebuilt from boundary tags.
+};
+
+#if defined(APEMODE_FIXED_ALLOCATOR_HAS_MMAP)
+
+//
+// FixedAllocator over a memory-mapped file that keeps its allocations across restarts.
+// Reopening maps the file and resumes: after a clean shutdown the used blocks are walked between the saved free
+// ranges, after a crash all blocks are walked through their boundary tags (BoundaryTagBlockFormat only, other
+// formats refuse to open a dirty arena). The result must pass good() before the arena is handed out.
+// Pointers into the heap change between runs, persistent data links its blocks with offsetOf()/at() and is
+// found again through root().
+//
+
+template <typename AllocatorType>
+struct PersistentFixedArena {
+    using allocator_type = AllocatorType;
+    using size_type = typename AllocatorType::size_type;
+    using range_type = typename AllocatorType::range_type;
+    using container_type = typename AllocatorType::container_type;
+    using exception_policy = typename AllocatorType::exception_policy;
+    using layout_type = typename AllocatorType::layout_type;
+
+    static_assert(std::is_constructible<container_type, uint8_t*, size_t>::value, "Heaps are constructed from (data, size).");
+    static_assert(!layout_type::headerless, "Headerless blocks cannot be walked on restart.");
+
+    static constexpr uint32_t layoutId = uint32_t(sizeof(size_type)) | (layout_type::boundaryTags ? 0x100u : 0u);
+
+    int fd = -1;
+    uint8_t* mapping = nullptr;
+    size_t mappingSize = 0;
+    PersistentArenaHeader* header = nullptr;
+    PersistentArenaRange* rangeTable = nullptr;
+    PersistentArenaState state = PersistentArenaState::Created;
+    std::unique_ptr<AllocatorType> allocator{};
+
+    //
+    // Opens the arena at the path, or creates it with heapSize bytes of heap and room for rangeCapacity free ranges.
+    // The sizes of an existing arena come from its header.
+    //
+
+    PersistentFixedArena(const std::string& path, size_t heapSize, size_t rangeCapacity = 65536) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+
+        struct stat fileStat = {};
+        if (fd < 0 || ::fstat(fd, &fileStat) != 0) {
+            fail("Persistent arena file cannot be opened.");
+            return;
+        }
+
+        if (fileStat.st_size == 0) {
+            create(heapSize, rangeCapacity);
+        } else {
+            open(static_cast<size_t>(fileStat.st_size));
+        }
+    }
+
+    PersistentFixedArena(const PersistentFixedArena&) = delete;
+    PersistentFixedArena& operator=(const PersistentFixedArena&) = delete;
+    ~PersistentFixedArena() { close(); }
+
+    void create(size_t heapSize, size_t rangeCapacity) {
+        size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t tableEnd = sizeof(PersistentArenaHeader) + rangeCapacity * sizeof(PersistentArenaRange);
+        size_t heapOffset = (tableEnd + pageSize - 1) / pageSize * pageSize;
+
+        if (heapSize >= std::numeric_limits<size_type>::max()) { return fail("Persistent arena heap is too large."); }
+        if (::ftruncate(fd, static_cast<off_t>(heapOffset + heapSize)) != 0) { return fail("Persistent arena file cannot be resized."); }
+        if (!map(heapOffset + heapSize)) { return; }
+
+        header = new (mapping) PersistentArenaHeader();
+        header->layoutId = layoutId;
+        header->heapOffset = heapOffset;
+        header->heapSize = heapSize;
+        header->rangeCapacity = rangeCapacity;
+        rangeTable = reinterpret_cast<PersistentArenaRange*>(mapping + sizeof(PersistentArenaHeader));
+
+        allocator.reset(new AllocatorType(container_type(heap(), heapSize)));
+        state = PersistentArenaState::Created;
+        syncHeader();
+    }
+
+    void open(size_t fileSize) {
+        if (fileSize < sizeof(PersistentArenaHeader)) { return fail("Persistent arena file is truncated."); }
+        if (!map(fileSize)) { return; }
+
+        header = reinterpret_cast<PersistentArenaHeader*>(mapping);
+        rangeTable = reinterpret_cast<PersistentArenaRange*>(mapping + sizeof(PersistentArenaHeader));
+
+        if (header->magic != PersistentArenaHeader::magicValue) { return fail("Persistent arena file has no arena header."); }
+        if (header->version != PersistentArenaHeader::currentVersion) { return fail("Persistent arena has an unsupported version."); }
+        if (header->layoutId != layoutId) { return fail("Persistent arena was created with a different block format."); }
+        if (header->heapOffset < sizeof(PersistentArenaHeader) + header->rangeCapacity * sizeof(PersistentArenaRange) ||
+            header->heapOffset + header->heapSize != fileSize) {
+            return fail("Persistent arena file is truncated.");
+        }
+
+        allocator.reset(new AllocatorType(container_type(heap(), static_cast<size_t>(header->heapSize)), FixedAllocatorAttach{}));
+
+        bool resumed = false;
+        if (header->cleanShutdown && header->rangeCount <= header->rangeCapacity) {
+            std::vector<range_type> freeRanges(static_cast<size_t>(header->rangeCount));
+            for (size_t i = 0; i < freeRanges.size(); ++i) {
+                freeRanges[i] = {static_cast<size_type>(rangeTable[i].offset), static_cast<size_type>(rangeTable[i].size)};
+            }
+
+            resumed = allocator->restore(freeRanges.data(), freeRanges.size());
+            state = PersistentArenaState::Restored;
+        }
+
+        if constexpr (layout_type::boundaryTags) {
+            if (!resumed) {
+                resumed = allocator->recover();
+                state = PersistentArenaState::Recovered;
+            }
+        } else {
+            if (!header->cleanShutdown) { return fail("Persistent arena was not shut down cleanly."); }
+        }
+
+        if (!resumed || !allocator->good()) { return fail("Persistent arena failed the consistency check."); }
+
+        header->cleanShutdown = 0;
+        syncHeader();
+    }
+
+    //
+    // Saves the free ranges, marks the shutdown as clean and unmaps the file.
+    // Heap contents are flushed before the flag, so a torn shutdown reads as a crash.
+    //
+
+    void close() {
+        if (mapping && allocator) {
+            uint64_t rangeCount = 0;
+            allocator->forEachFreeRange([&](const range_type& r) {
+                if (rangeCount < header->rangeCapacity) { rangeTable[rangeCount] = {r.offset, r.size}; }
+                ++rangeCount;
+            });
+
+            header->rangeCount = rangeCount;
+            sync();
+
+            header->cleanShutdown = rangeCount <= header->rangeCapacity ? 1 : 0;
+            syncHeader();
+        }
+
+        release();
+    }
+
+    //
+    // Flushes the heap to the file. The arena stays open (and dirty).
+    //
+
+    void sync() {
+        if (mapping) { ::msync(mapping, mappingSize, MS_SYNC); }
+    }
+
+    uint8_t* heap() const { return mapping + header->heapOffset; }
+
+    uint64_t offsetOf(const void* dataPtr) const {
+        return dataPtr ? static_cast<uint64_t>(reinterpret_cast<const uint8_t*>(dataPtr) - heap()) : PersistentArenaHeader::nullOffset;
+    }
+
+    void* at(uint64_t offset) const {
+        return offset != PersistentArenaHeader::nullOffset ? heap() + offset : nullptr;
+    }
+
+    void* root() const { return at(header->rootOffset); }
+    void setRoot(const void* dataPtr) { header->rootOffset = offsetOf(dataPtr); }
+
+    bool map(size_t size) {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            fail("Persistent arena file cannot be mapped.");
+            return false;
+        }
+
+        mapping = static_cast<uint8_t*>(p);
+        mappingSize = size;
+        return true;
+    }
+
+    void syncHeader() {
+        ::msync(mapping, sizeof(PersistentArenaHeader), MS_SYNC);
+    }
+
+    void release() {
+        allocator.reset();
+        if (mapping) { ::munmap(mapping, mappingSize); }
+        if (fd >= 0) { ::close(fd); }
+
+        mapping = nullptr;
+        mappingSize = 0;
+        header = nullptr;
+        rangeTable = nullptr;
+        fd = -1;
+    }
+
+    void fail(const char* message) {
+        release();
+        exception_policy::template raiseError<std::runtime_error>(message);
+    }
+};
+
+#endif
+
+}
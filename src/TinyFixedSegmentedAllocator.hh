@@ -0,0 +1,302 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+#include <cstdlib>
+#include <memory>
+
+namespace apemode {
+namespace defaults {
+
+//
+// Segment sources hand out the memory of new segments and take it back once the segment is released.
+//
+
+struct MallocSegmentSource {
+    uint8_t* acquire(size_t size) { return static_cast<uint8_t*>(std::malloc(size)); }
+    void release(uint8_t* dataPtr, size_t) noexcept { std::free(dataPtr); }
+};
+}
+
+//
+// Chains FixedAllocator segments instead of failing when the first container is full.
+// On exhaustion a new segment is taken from the segment source, each one growthFactor times larger than the previous
+// (and at least large enough for the request). Segments are kept in a directory sorted by address, so free() finds
+// the owning segment with a binary search.
+// A segment that becomes empty is released once releaseDelay more frees went by and it is still empty, so a workload
+// that oscillates around a segment boundary does not acquire and release the same segment over and over.
+// The first container belongs to the caller and is never released.
+//
+
+template <typename AllocatorType, typename SegmentSource = defaults::MallocSegmentSource>
+struct SegmentedFixedAllocator {
+    using allocator_type = AllocatorType;
+    using size_type = typename AllocatorType::size_type;
+    using container_type = typename AllocatorType::container_type;
+    using exception_policy = typename AllocatorType::exception_policy;
+    using lock_policy = typename AllocatorType::lock_policy;
+    using layout_type = typename AllocatorType::layout_type;
+
+    static_assert(std::is_constructible<container_type, uint8_t*, size_t>::value, "Segments are constructed from (data, size).");
+
+    static constexpr size_t notEmpty = ~size_t(0);
+
+    struct Segment {
+        std::unique_ptr<AllocatorType> allocator{};
+        uint8_t* dataPtr = nullptr;
+        size_t dataSize = 0;
+        bool owned = false;
+        std::atomic<size_t> emptySince = {notEmpty};
+    };
+
+    SegmentSource source{};
+    size_t growthFactor = 2;
+    size_t maxSegmentSize = std::numeric_limits<size_type>::max();
+    size_t releaseDelay = 0;
+    size_t nextSegmentSize = 0;
+    std::vector<std::unique_ptr<Segment>> segments{};
+    std::atomic<Segment*> activeSegment = {nullptr};
+    std::atomic<size_t> freeTicks = {0};
+    std::atomic<size_t> releaseTick = {notEmpty};
+    mutable typename lock_policy::Lock directoryLock{};
+
+    explicit SegmentedFixedAllocator(const container_type& c, const SegmentSource& s = SegmentSource(), size_t delay = 1024)
+        : source(s), releaseDelay(delay) {
+        nextSegmentSize = std::min(c.size() * growthFactor, maxSegmentSize);
+        activeSegment.store(insertSegment(c.data(), c.size(), false), std::memory_order_relaxed);
+    }
+
+    SegmentedFixedAllocator(const SegmentedFixedAllocator&) = delete;
+    SegmentedFixedAllocator& operator=(const SegmentedFixedAllocator&) = delete;
+
+    ~SegmentedFixedAllocator() {
+        for (auto& segment : segments) { releaseSegment(*segment); }
+    }
+
+    defaults::ByteSpan allocByteSpanAligned(size_type size, size_type alignment) {
+        {
+            typename lock_policy::SharedLockGuard lockGuard(directoryLock);
+            auto allocatedSpan = allocFromSegments(size, alignment);
+            if (allocatedSpan.data()) { return allocatedSpan; }
+        }
+
+        //
+        // Another thread may have grown the directory while this one was waiting for the lock.
+        //
+
+        typename lock_policy::UniqueLockGuard lockGuard(directoryLock);
+        auto allocatedSpan = allocFromSegments(size, alignment);
+        if (allocatedSpan.data()) { return allocatedSpan; }
+
+        Segment* segment = grow(size, alignment);
+        return segment ? allocFrom(*segment, size, alignment) : defaults::ByteSpan{};
+    }
+
+    defaults::ByteSpan allocByteSpan(size_type size) { return allocByteSpanAligned(size, 1); }
+    void* alloc(size_type size) { return allocByteSpan(size).data(); }
+    void* allocAligned(size_type size, size_type alignment) { return allocByteSpanAligned(size, alignment).data(); }
+
+    void free(void* dataPtr) noexcept(exception_policy::NoexceptFree) {
+        freeWith(dataPtr, [&](AllocatorType& allocator) { allocator.free(dataPtr); });
+    }
+
+    void free(void* dataPtr, size_type size) noexcept(exception_policy::NoexceptFree) {
+        freeWith(dataPtr, [&](AllocatorType& allocator) { allocator.free(dataPtr, size); });
+    }
+
+    size_type allocationSize(const void* dataPtr) const {
+        typename lock_policy::SharedLockGuard lockGuard(directoryLock);
+        const Segment* segment = segmentOf(dataPtr);
+        return segment ? segment->allocator->allocationSize(dataPtr) : 0;
+    }
+
+    //
+    // Releases every empty segment now, without waiting for the delay.
+    //
+
+    void trim() {
+        typename lock_policy::UniqueLockGuard lockGuard(directoryLock);
+        releaseEmptySegments(notEmpty - 1);
+    }
+
+    size_t segmentCount() const {
+        typename lock_policy::SharedLockGuard lockGuard(directoryLock);
+        return segments.size();
+    }
+
+    size_t capacity() const {
+        typename lock_policy::SharedLockGuard lockGuard(directoryLock);
+
+        size_t totalSize = 0;
+        for (auto& segment : segments) { totalSize += segment->dataSize; }
+        return totalSize;
+    }
+
+    size_t totalFreeSpace() const {
+        typename lock_policy::SharedLockGuard lockGuard(directoryLock);
+
+        size_t totalFreeSize = 0;
+        for (auto& segment : segments) { totalFreeSize += segment->allocator->totalFreeSpace(); }
+        return totalFreeSize;
+    }
+
+    size_t totalOccupiedSpace() const {
+        return capacity() - totalFreeSpace();
+    }
+
+    bool good() const {
+        typename lock_policy::SharedLockGuard lockGuard(directoryLock);
+
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (i && segments[i - 1]->dataPtr + segments[i - 1]->dataSize > segments[i]->dataPtr) { return false; }
+            if (!segments[i]->allocator->good()) { return false; }
+        }
+
+        return true;
+    }
+
+    defaults::ByteSpan allocFrom(Segment& segment, size_type size, size_type alignment) {
+        auto allocatedSpan = segment.allocator->allocByteSpanAligned(size, alignment);
+        if (allocatedSpan.data()) {
+            activeSegment.store(&segment, std::memory_order_relaxed);
+            if (segment.emptySince.load(std::memory_order_relaxed) != notEmpty) {
+                segment.emptySince.store(notEmpty, std::memory_order_relaxed);
+            }
+        }
+
+        return allocatedSpan;
+    }
+
+    //
+    // The segment that served the last allocation goes first, then the rest of the directory.
+    //
+
+    defaults::ByteSpan allocFromSegments(size_type size, size_type alignment) {
+        Segment* active = activeSegment.load(std::memory_order_relaxed);
+        auto allocatedSpan = allocFrom(*active, size, alignment);
+        if (allocatedSpan.data()) { return allocatedSpan; }
+
+        for (size_t i = segments.size(); i-- > 0;) {
+            if (segments[i].get() == active) { continue; }
+
+            allocatedSpan = allocFrom(*segments[i], size, alignment);
+            if (allocatedSpan.data()) { return allocatedSpan; }
+        }
+
+        return {};
+    }
+
+    Segment* grow(size_type size, size_type alignment) {
+        size_t requiredSize = size_t(size) + alignment + layout_type::headerSize + layout_type::trailerSize + layout_type::minFragmentSize;
+        size_t segmentSize = std::max(nextSegmentSize, requiredSize);
+        if (segmentSize > maxSegmentSize) { return nullptr; }
+
+        uint8_t* dataPtr = source.acquire(segmentSize);
+        if (!dataPtr) { return nullptr; }
+
+        nextSegmentSize = std::min(std::max(segmentSize, segmentSize * growthFactor), maxSegmentSize);
+        return insertSegment(dataPtr, segmentSize, true);
+    }
+
+    Segment* insertSegment(uint8_t* dataPtr, size_t dataSize, bool owned) {
+        std::unique_ptr<Segment> segment(new Segment());
+        segment->allocator.reset(new AllocatorType(container_type(dataPtr, dataSize)));
+        segment->dataPtr = dataPtr;
+        segment->dataSize = dataSize;
+        segment->owned = owned;
+
+        auto segmentIt = std::upper_bound(segments.begin(), segments.end(), dataPtr, [](const uint8_t* p, const std::unique_ptr<Segment>& s) {
+            return p < s->dataPtr;
+        });
+
+        return segments.insert(segmentIt, std::move(segment))->get();
+    }
+
+    void releaseSegment(Segment& segment) noexcept {
+        segment.allocator.reset();
+        if (segment.owned) { source.release(segment.dataPtr, segment.dataSize); }
+    }
+
+    Segment* segmentOf(const void* dataPtr) const {
+        auto p = reinterpret_cast<const uint8_t*>(dataPtr);
+        auto segmentIt = std::upper_bound(segments.begin(), segments.end(), p, [](const uint8_t* p, const std::unique_ptr<Segment>& s) {
+            return p < s->dataPtr;
+        });
+
+        if (segmentIt == segments.begin()) { return nullptr; }
+
+        Segment* segment = (--segmentIt)->get();
+        return p < segment->dataPtr + segment->dataSize ? segment : nullptr;
+    }
+
+    template <typename FreeFn>
+    void freeWith(void* dataPtr, FreeFn freeFn) noexcept(exception_policy::NoexceptFree) {
+        if (!dataPtr) { return; }
+
+        size_t tick = 0;
+        {
+            typename lock_policy::SharedLockGuard lockGuard(directoryLock);
+
+            Segment* segment = segmentOf(dataPtr);
+            if (!segment) {
+                exception_policy::template raiseError<std::runtime_error>("Memory range is out of bounds.");
+                return;
+            }
+
+            freeFn(*segment->allocator);
+            tick = freeTicks.fetch_add(1, std::memory_order_relaxed) + 1;
+
+            //
+            // Empty segments remember when they became empty, the earliest deadline wakes up the release below.
+            //
+
+            if (segment->owned && !segment->allocator->stats().liveAllocations) {
+                segment->emptySince.store(tick, std::memory_order_relaxed);
+
+                size_t deadline = tick + releaseDelay;
+                size_t currentTick = releaseTick.load(std::memory_order_relaxed);
+                while (deadline < currentTick && !releaseTick.compare_exchange_weak(currentTick, deadline, std::memory_order_relaxed)) {}
+            }
+        }
+
+        if (tick >= releaseTick.load(std::memory_order_relaxed)) {
+            typename lock_policy::UniqueLockGuard lockGuard(directoryLock);
+            releaseEmptySegments(tick);
+        }
+    }
+
+    //
+    // Called under the unique directory lock, so no allocation races with the emptiness check.
+    // A released active segment is replaced by the caller's segment once the loop is done, it is never released.
+    //
+
+    void releaseEmptySegments(size_t tick) noexcept {
+        Segment* active = activeSegment.load(std::memory_order_relaxed);
+        bool activeReleased = false;
+
+        size_t nextReleaseTick = notEmpty;
+        for (size_t i = 0; i < segments.size();) {
+            Segment& segment = *segments[i];
+            size_t emptySince = segment.emptySince.load(std::memory_order_relaxed);
+
+            if (!segment.owned || emptySince == notEmpty || segment.allocator->stats().liveAllocations) {
+                ++i;
+            } else if (emptySince + releaseDelay > tick) {
+                nextReleaseTick = std::min(nextReleaseTick, emptySince + releaseDelay);
+                ++i;
+            } else {
+                activeReleased |= &segment == active;
+                releaseSegment(segment);
+                segments.erase(segments.begin() + i);
+            }
+        }
+
+        if (activeReleased) {
+            auto segmentIt = std::find_if(segments.begin(), segments.end(), [](const std::unique_ptr<Segment>& s) { return !s->owned; });
+            activeSegment.store(segmentIt->get(), std::memory_order_relaxed);
+        }
+
+        releaseTick.store(nextReleaseTick, std::memory_order_relaxed);
+    }
+};
+
+}
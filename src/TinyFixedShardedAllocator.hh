@@ -0,0 +1,140 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+#include <memory>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace apemode {
+namespace defaults {
+
+//
+// Shard selectors map the calling thread to its home shard.
+//
+
+struct ThreadShardSelector {
+    static size_t threadOrdinal() {
+        static std::atomic<size_t> threadCounter = {0};
+        static thread_local const size_t ordinal = threadCounter.fetch_add(1, std::memory_order_relaxed);
+        return ordinal;
+    }
+
+    static size_t select(size_t shardCount) { return threadOrdinal() % shardCount; }
+};
+
+struct CpuShardSelector {
+    static size_t select(size_t shardCount) {
+#if defined(__linux__)
+        int cpu = sched_getcpu();
+        if (cpu >= 0) { return static_cast<size_t>(cpu) % shardCount; }
+#endif
+        return ThreadShardSelector::select(shardCount);
+    }
+};
+}
+
+//
+// Splits one container into equally sized shards, each managed by its own FixedAllocator (and its own lock).
+// Threads allocate from their home shard and steal from the following shards when it runs dry.
+// free() finds the owning shard from the address in O(1).
+//
+
+template <typename AllocatorType, typename ShardSelector = defaults::ThreadShardSelector>
+struct ShardedFixedAllocator {
+    using allocator_type = AllocatorType;
+    using size_type = typename AllocatorType::size_type;
+    using container_type = typename AllocatorType::container_type;
+    using exception_policy = typename AllocatorType::exception_policy;
+
+    static_assert(std::is_constructible<container_type, uint8_t*, size_t>::value, "Shards are constructed from (data, size).");
+
+    const container_type container{};
+    size_t shardSize = 0;
+    std::vector<std::unique_ptr<AllocatorType>> shards{};
+
+    ShardedFixedAllocator(const container_type& c, size_t shardCount) : container(c) {
+        assert(shardCount > 0);
+        shardSize = container.size() / shardCount;
+        assert(shardSize > 0);
+
+        //
+        // The last shard takes the remainder.
+        //
+
+        shards.reserve(shardCount);
+        for (size_t i = 0; i < shardCount; ++i) {
+            size_t size = i + 1 < shardCount ? shardSize : container.size() - shardSize * i;
+            shards.emplace_back(new AllocatorType(container_type(container.data() + shardSize * i, size)));
+        }
+    }
+
+    size_t homeShard() const { return ShardSelector::select(shards.size()); }
+
+    defaults::ByteSpan allocByteSpanAligned(size_type size, size_type alignment) {
+        size_t home = homeShard();
+        for (size_t i = 0; i < shards.size(); ++i) {
+            auto& shard = shards[(home + i) % shards.size()];
+            auto allocatedSpan = shard->allocByteSpanAligned(size, alignment);
+            if (allocatedSpan.data()) { return allocatedSpan; }
+        }
+
+        return {};
+    }
+
+    defaults::ByteSpan allocByteSpan(size_type size) { return allocByteSpanAligned(size, 1); }
+    void* alloc(size_type size) { return allocByteSpan(size).data(); }
+    void* allocAligned(size_type size, size_type alignment) { return allocByteSpanAligned(size, alignment).data(); }
+
+    size_t shardIndexOf(const void* dataPtr) const {
+        auto p = reinterpret_cast<const uint8_t*>(dataPtr);
+        return std::min(static_cast<size_t>(p - container.data()) / shardSize, shards.size() - 1);
+    }
+
+    void free(void* dataPtr) noexcept(exception_policy::NoexceptFree) {
+        if (!dataPtr) { return; }
+
+        auto p = reinterpret_cast<uint8_t*>(dataPtr);
+        if (p < container.data() || p >= container.data() + container.size()) {
+            exception_policy::template raiseError<std::runtime_error>("Memory range is out of bounds.");
+        }
+
+        shards[shardIndexOf(dataPtr)]->free(dataPtr);
+    }
+
+    void free(void* dataPtr, size_type size) noexcept(exception_policy::NoexceptFree) {
+        if (!dataPtr) { return; }
+
+        auto p = reinterpret_cast<uint8_t*>(dataPtr);
+        if (p < container.data() || p >= container.data() + container.size()) {
+            exception_policy::template raiseError<std::runtime_error>("Memory range is out of bounds.");
+        }
+
+        shards[shardIndexOf(dataPtr)]->free(dataPtr, size);
+    }
+
+    size_type allocationSize(const void* dataPtr) const {
+        return shards[shardIndexOf(dataPtr)]->allocationSize(dataPtr);
+    }
+
+    size_t totalFreeSpace() const {
+        size_t totalFreeSize = 0;
+        for (auto& shard : shards) { totalFreeSize += shard->totalFreeSpace(); }
+        return totalFreeSize;
+    }
+
+    size_t totalOccupiedSpace() const {
+        return container.size() - totalFreeSpace();
+    }
+
+    bool good() const {
+        for (auto& shard : shards) {
+            if (!shard->good()) { return false; }
+        }
+
+        return true;
+    }
+};
+
+}
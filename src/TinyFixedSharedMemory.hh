@@ -0,0 +1,345 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+#include <new>
+#include <string>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define APEMODE_FIXED_ALLOCATOR_HAS_SHM 1
+#endif
+
+namespace apemode {
+
+//
+// Vector of at most Capacity elements stored inline, for range stores that must not touch the heap
+// (an allocator placed into shared memory). Capacity overflow is a logic error, callers keep the element count
+// below Capacity.
+//
+
+template <typename T, size_t Capacity>
+struct FixedCapacityVector {
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    static constexpr size_t maxSize = Capacity;
+
+    T items[Capacity] = {};
+    size_t count = 0;
+
+    iterator begin() { return items; }
+    iterator end() { return items + count; }
+    const_iterator begin() const { return items; }
+    const_iterator end() const { return items + count; }
+
+    size_t size() const { return count; }
+    bool empty() const { return 0 == count; }
+    void clear() { count = 0; }
+    void reserve(size_t n) { assert(n <= Capacity); }
+
+    T& back() { return items[count - 1]; }
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+
+    void push_back(const T& value) {
+        assert(count < Capacity);
+        items[count++] = value;
+    }
+
+    iterator insert(iterator pos, const T& value) {
+        assert(count < Capacity);
+        std::move_backward(pos, end(), end() + 1);
+        *pos = value;
+        ++count;
+        return pos;
+    }
+
+    iterator erase(iterator pos) {
+        std::move(pos + 1, end(), pos);
+        --count;
+        return pos;
+    }
+
+    void swap(FixedCapacityVector& other) {
+        std::swap_ranges(items, items + std::max(count, other.count), other.items);
+        std::swap(count, other.count);
+    }
+};
+
+//
+// Byte span that stores its data as an offset from its own address, so it stays valid in every process
+// that maps the segment it lives in, whatever the mapping address is. Copies are rebased to their new address.
+//
+
+struct SelfRelativeByteSpan {
+    int64_t dataOffset = 0;
+    size_t dataSize = 0;
+
+    SelfRelativeByteSpan() = default;
+    SelfRelativeByteSpan(uint8_t* dataPtr, size_t dataSize) : dataOffset(dataPtr - self()), dataSize(dataSize) {}
+    SelfRelativeByteSpan(const SelfRelativeByteSpan& rhs) : SelfRelativeByteSpan(rhs.data(), rhs.size()) {}
+
+    SelfRelativeByteSpan& operator=(const SelfRelativeByteSpan& rhs) {
+        uint8_t* dataPtr = rhs.data();
+        dataSize = rhs.size();
+        dataOffset = dataPtr - self();
+        return *this;
+    }
+
+    uint8_t* self() const { return reinterpret_cast<uint8_t*>(const_cast<SelfRelativeByteSpan*>(this)); }
+    uint8_t* data() const { return self() + dataOffset; }
+    size_t size() const { return dataSize; }
+    bool empty() const { return 0 == dataSize; }
+};
+
+#if defined(APEMODE_FIXED_ALLOCATOR_HAS_SHM)
+
+namespace defaults {
+
+//
+// Process-shared robust mutex. If the owner dies while holding it, the next locker takes it over and the death
+// is counted in ownerDeaths: the allocator metadata may then be half updated, check good() before trusting it.
+// Shared locking is exclusive.
+//
+
+struct RobustProcessMutex {
+    pthread_mutex_t mutex{};
+    std::atomic<uint32_t> ownerDeaths{0};
+
+    RobustProcessMutex() {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+
+    RobustProcessMutex(const RobustProcessMutex&) = delete;
+    RobustProcessMutex& operator=(const RobustProcessMutex&) = delete;
+
+    void lock() {
+        if (pthread_mutex_lock(&mutex) == EOWNERDEAD) { takeOver(); }
+    }
+
+    bool try_lock() {
+        int rc = pthread_mutex_trylock(&mutex);
+        if (rc == EOWNERDEAD) { takeOver(); }
+        return rc == 0 || rc == EOWNERDEAD;
+    }
+
+    void unlock() { pthread_mutex_unlock(&mutex); }
+    void lock_shared() { lock(); }
+    bool try_lock_shared() { return try_lock(); }
+    void unlock_shared() { unlock(); }
+
+    void takeOver() {
+        ownerDeaths.fetch_add(1, std::memory_order_relaxed);
+        pthread_mutex_consistent(&mutex);
+    }
+};
+
+struct RobustProcessSharedLockPolicy {
+    using Lock = RobustProcessMutex;
+    using UniqueLockGuard = std::unique_lock<Lock>;
+    using SharedLockGuard = std::shared_lock<Lock>;
+};
+}
+
+//
+// Segment layout: the header, the allocator object, then the heap. The allocator keeps all of its state inline
+// (a fixed-capacity range vector, a stateless fit policy, the robust mutex) and reaches the heap through
+// a self-relative span, so every process uses it in place.
+//
+
+struct SharedMemoryArenaHeader {
+    static constexpr uint64_t magicValue = 0x4d454d4853584946ull; // "FIXSHMEM"
+    static constexpr uint32_t currentVersion = 1;
+    static constexpr uint64_t nullOffset = ~uint64_t(0);
+
+    uint64_t magic = magicValue;
+    uint32_t version = currentVersion;
+    uint32_t allocatorSize = 0;
+    uint64_t allocatorOffset = 0;
+    uint64_t heapOffset = 0;
+    uint64_t heapSize = 0;
+    std::atomic<uint64_t> liveBlocks{0};
+    std::atomic<uint64_t> rootOffset{nullOffset};
+    std::atomic<uint32_t> ready{0};
+};
+
+//
+// FixedAllocator in a POSIX shared-memory segment, for zero-copy payload exchange between processes.
+// One process creates the segment, the others open it by name. Blocks are passed around as heap offsets
+// (offsetOf()/at()), consumers read payloads in place.
+// A free range table of RangeCapacity entries bounds the number of live blocks to RangeCapacity - 1
+// (free ranges are separated by live blocks, one allocation adds at most one range).
+// Batch and resize calls of the allocator bypass the live block count and are not exposed.
+//
+
+template <typename SizeType = uint32_t, size_t RangeCapacity = 4096, typename BlockFormat = defaults::SizeHeaderBlockFormat>
+struct SharedMemoryArena {
+    using size_type = SizeType;
+    using allocator_type = FixedAllocator<SizeType,
+                                          SelfRelativeByteSpan,
+                                          FixedCapacityVector<FixedAllocatorRange<SizeType>, RangeCapacity>,
+                                          defaults::DefaultExceptionPolicy,
+                                          defaults::RobustProcessSharedLockPolicy,
+                                          defaults::FirstFitPolicy,
+                                          BlockFormat>;
+    using exception_policy = typename allocator_type::exception_policy;
+
+    static_assert(RangeCapacity >= 2, "The range table must hold at least two ranges.");
+    static_assert(!allocator_type::layout_type::checkSizes, "Out-of-band size checks are process-local.");
+    static_assert(std::is_trivially_destructible<allocator_type>::value, "The allocator must not own process-local heap memory.");
+
+    static constexpr size_t maxLiveBlocks = RangeCapacity - 1;
+
+    int fd = -1;
+    uint8_t* mapping = nullptr;
+    size_t mappingSize = 0;
+    SharedMemoryArenaHeader* header = nullptr;
+    allocator_type* allocator = nullptr;
+
+    //
+    // Creates the segment with heapSize bytes of heap, fails if the name is taken.
+    //
+
+    SharedMemoryArena(const std::string& name, size_t heapSize) {
+        size_t allocatorOffset = alignUp(sizeof(SharedMemoryArenaHeader));
+        size_t heapOffset = alignUp(allocatorOffset + sizeof(allocator_type));
+        size_t segmentSize = heapOffset + heapSize;
+
+        fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(segmentSize)) != 0) {
+            fail("Shared memory segment cannot be created.");
+            return;
+        }
+
+        if (!map(segmentSize)) { return; }
+
+        header = new (mapping) SharedMemoryArenaHeader();
+        header->allocatorSize = static_cast<uint32_t>(sizeof(allocator_type));
+        header->allocatorOffset = allocatorOffset;
+        header->heapOffset = heapOffset;
+        header->heapSize = heapSize;
+
+        allocator = new (mapping + allocatorOffset) allocator_type(SelfRelativeByteSpan(mapping + heapOffset, heapSize));
+        header->ready.store(1, std::memory_order_release);
+    }
+
+    //
+    // Opens a segment created by another process.
+    //
+
+    explicit SharedMemoryArena(const std::string& name) {
+        fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+
+        struct stat segmentStat = {};
+        if (fd < 0 || ::fstat(fd, &segmentStat) != 0 || size_t(segmentStat.st_size) < sizeof(SharedMemoryArenaHeader)) {
+            fail("Shared memory segment cannot be opened.");
+            return;
+        }
+
+        if (!map(static_cast<size_t>(segmentStat.st_size))) { return; }
+
+        header = reinterpret_cast<SharedMemoryArenaHeader*>(mapping);
+        if (header->magic != SharedMemoryArenaHeader::magicValue || header->version != SharedMemoryArenaHeader::currentVersion ||
+            !header->ready.load(std::memory_order_acquire)) {
+            fail("Shared memory segment holds no arena.");
+            return;
+        }
+
+        if (header->allocatorSize != sizeof(allocator_type) || header->heapOffset + header->heapSize != mappingSize) {
+            fail("Shared memory arena was created with a different configuration.");
+            return;
+        }
+
+        allocator = reinterpret_cast<allocator_type*>(mapping + header->allocatorOffset);
+    }
+
+    SharedMemoryArena(const SharedMemoryArena&) = delete;
+    SharedMemoryArena& operator=(const SharedMemoryArena&) = delete;
+    ~SharedMemoryArena() { release(); }
+
+    //
+    // Removes the name, processes that have the segment mapped keep using it.
+    //
+
+    static void unlink(const std::string& name) { ::shm_unlink(name.c_str()); }
+
+    void* alloc(size_type size) { return allocAligned(size, 1); }
+
+    void* allocAligned(size_type size, size_type alignment) {
+        if (header->liveBlocks.fetch_add(1, std::memory_order_relaxed) >= maxLiveBlocks) {
+            header->liveBlocks.fetch_sub(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        void* dataPtr = allocator->allocAligned(size, alignment);
+        if (!dataPtr) { header->liveBlocks.fetch_sub(1, std::memory_order_relaxed); }
+        return dataPtr;
+    }
+
+    void free(void* dataPtr) {
+        if (!dataPtr) { return; }
+
+        allocator->free(dataPtr);
+        header->liveBlocks.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    uint8_t* heap() const { return mapping + header->heapOffset; }
+
+    uint64_t offsetOf(const void* dataPtr) const {
+        return dataPtr ? static_cast<uint64_t>(reinterpret_cast<const uint8_t*>(dataPtr) - heap()) : SharedMemoryArenaHeader::nullOffset;
+    }
+
+    void* at(uint64_t offset) const {
+        return offset != SharedMemoryArenaHeader::nullOffset ? heap() + offset : nullptr;
+    }
+
+    void* root() const { return at(header->rootOffset.load(std::memory_order_acquire)); }
+    void setRoot(const void* dataPtr) { header->rootOffset.store(offsetOf(dataPtr), std::memory_order_release); }
+
+    uint32_t ownerDeaths() const { return allocator->lock.ownerDeaths.load(std::memory_order_relaxed); }
+
+    static size_t alignUp(size_t size) { return (size + 63) & ~size_t(63); }
+
+    bool map(size_t size) {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            fail("Shared memory segment cannot be mapped.");
+            return false;
+        }
+
+        mapping = static_cast<uint8_t*>(p);
+        mappingSize = size;
+        return true;
+    }
+
+    void release() {
+        if (mapping) { ::munmap(mapping, mappingSize); }
+        if (fd >= 0) { ::close(fd); }
+
+        mapping = nullptr;
+        mappingSize = 0;
+        header = nullptr;
+        allocator = nullptr;
+        fd = -1;
+    }
+
+    void fail(const char* message) {
+        release();
+        exception_policy::template raiseError<std::runtime_error>(message);
+    }
+};
+
+#endif
+
+}
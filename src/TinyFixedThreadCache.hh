@@ -0,0 +1,138 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+
+namespace apemode {
+
+//
+// Per-thread front end for a shared FixedAllocator, meant to live in thread-local storage (one instance per thread
+// and allocator). The cache itself is not thread-safe.
+// Requests up to MaxCachedSize bytes are rounded up to a power-of-two size class. Freed blocks of a class are kept
+// in a magazine and handed out again without touching the allocator lock. An empty magazine is refilled with half
+// a magazine of blocks, a full one flushes half of its blocks back to the allocator, both with a single batch call.
+// Blocks keep their regular header, so any thread may free them through its own cache or through the allocator.
+// Cached blocks count as occupied space of the allocator until they are flushed.
+//
+
+template <typename AllocatorType, size_t MagazineSize = 32, size_t MaxCachedSize = 1024>
+struct FixedAllocatorThreadCache {
+    using allocator_type = AllocatorType;
+    using size_type = typename AllocatorType::size_type;
+
+    static_assert(MagazineSize >= 2, "Magazine must hold at least two blocks.");
+    static_assert(MaxCachedSize >= 16 && !(MaxCachedSize & (MaxCachedSize - 1)), "MaxCachedSize must be a power of two.");
+
+    static constexpr uint32_t minClassLog2 = 4;
+    static constexpr uint32_t maxClassLog2() {
+        uint32_t log2 = 0;
+        while ((size_t(1) << log2) < MaxCachedSize) { ++log2; }
+        return log2;
+    }
+
+    static constexpr uint32_t classCount = maxClassLog2() - minClassLog2 + 1;
+
+    struct Magazine {
+        void* blocks[MagazineSize] = {};
+        size_t count = 0;
+    };
+
+    AllocatorType* allocator = nullptr;
+    Magazine magazines[classCount] = {};
+
+    explicit FixedAllocatorThreadCache(AllocatorType& a) : allocator(&a) {}
+    FixedAllocatorThreadCache(const FixedAllocatorThreadCache&) = delete;
+    FixedAllocatorThreadCache& operator=(const FixedAllocatorThreadCache&) = delete;
+    ~FixedAllocatorThreadCache() { flush(); }
+
+    static uint32_t classIndex(size_type size) {
+        if (size <= (size_type(1) << minClassLog2)) { return 0; }
+        return detail::findLastSet(uint64_t(size) - 1) + 1 - minClassLog2;
+    }
+
+    static size_type classSize(uint32_t classIdx) {
+        return static_cast<size_type>(size_type(1) << (classIdx + minClassLog2));
+    }
+
+    void* alloc(size_type size) {
+        if (size > MaxCachedSize) { return allocator->alloc(size); }
+
+        uint32_t classIdx = classIndex(size);
+        Magazine& magazine = magazines[classIdx];
+        if (!magazine.count) { refill(classIdx); }
+        if (!magazine.count) { return nullptr; }
+
+        return magazine.blocks[--magazine.count];
+    }
+
+    void free(void* dataPtr) {
+        if (!dataPtr) { return; }
+
+        //
+        // Only blocks of exactly a class size can be cached, everything else goes straight to the allocator.
+        //
+
+        size_type size = allocator->allocationSize(dataPtr);
+        uint32_t classIdx = classIndex(size);
+        if (size > MaxCachedSize || size != classSize(classIdx)) {
+            allocator->free(dataPtr);
+            return;
+        }
+
+        Magazine& magazine = magazines[classIdx];
+        if (magazine.count == MagazineSize) { flush(classIdx, MagazineSize / 2); }
+
+        magazine.blocks[magazine.count++] = dataPtr;
+    }
+
+    //
+    // Returns all cached blocks to the allocator, call it before the owning thread exits
+    // if the cache is not destroyed with the thread.
+    //
+
+    void flush() {
+        for (uint32_t classIdx = 0; classIdx < classCount; ++classIdx) {
+            flush(classIdx, magazines[classIdx].count);
+        }
+    }
+
+    //
+    // Returns the oldest blocks (the bottom of the magazine), the recently freed, cache-hot blocks stay on top.
+    //
+
+    void flush(uint32_t classIdx, size_t blockCount) {
+        Magazine& magazine = magazines[classIdx];
+        blockCount = std::min(blockCount, magazine.count);
+        if (!blockCount) { return; }
+
+        allocator->freeBatch(magazine.blocks, blockCount);
+        std::copy(magazine.blocks + blockCount, magazine.blocks + magazine.count, magazine.blocks);
+        magazine.count -= blockCount;
+    }
+
+    void refill(uint32_t classIdx) {
+        Magazine& magazine = magazines[classIdx];
+        if (magazine.count >= MagazineSize / 2) { return; }
+
+        size_type sizes[MagazineSize / 2];
+        size_t blockCount = MagazineSize / 2 - magazine.count;
+        std::fill(sizes, sizes + blockCount, classSize(classIdx));
+
+        //
+        // Blocks that did not fit come back as nullptr, keep the allocated ones packed.
+        //
+
+        size_t first = magazine.count;
+        allocator->allocBatch(sizes, blockCount, magazine.blocks + first);
+        for (size_t i = first; i < first + blockCount; ++i) {
+            if (magazine.blocks[i]) { magazine.blocks[magazine.count++] = magazine.blocks[i]; }
+        }
+    }
+
+    size_t cachedBlockCount() const {
+        size_t count = 0;
+        for (auto& magazine : magazines) { count += magazine.count; }
+        return count;
+    }
+};
+
+}
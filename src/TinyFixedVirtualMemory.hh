@@ -0,0 +1,168 @@
+#pragma once
+
+#include <TinyFixedAllocator.hh>
+#include <memory>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define APEMODE_FIXED_ALLOCATOR_HAS_VIRTUAL_MEMORY 1
+#endif
+
+namespace apemode {
+
+struct VirtualMemoryOptions {
+    bool hugePages = false;                 // Align the reservation to huge pages and ask for transparent huge pages.
+    bool lazyFree = false;                  // MADV_FREE instead of MADV_DONTNEED, pages are reclaimed under pressure only.
+    size_t decommitThreshold = 256 * 1024;  // Free ranges below this size keep their pages, 0 never decommits.
+    size_t prefaultThreads = 0;             // Touch every page at reservation with this many threads, 0 commits lazily.
+};
+
+#if defined(APEMODE_FIXED_ALLOCATOR_HAS_VIRTUAL_MEMORY)
+
+//
+// Container that reserves address space with mmap instead of holding allocated memory. Pages are committed by the
+// kernel on first touch, so a mostly free arena costs only the pages its blocks ever used.
+// FixedAllocator reports coalesced free ranges to the container (decommitsFreeRanges), free ranges of at least
+// decommitThreshold bytes give the pages that just became free back to the OS. Decommitted pages read as zeros
+// (or keep their contents with lazyFree) and are committed again on the next touch.
+// With hugePages the reservation is aligned to 2 MB and decommits round to huge pages, so they do not split them.
+// Copies share the reservation, it is unmapped with the last copy. A failed reservation leaves the container empty.
+//
+
+struct VirtualMemoryContainer {
+    static constexpr bool decommitsFreeRanges = true;
+    static constexpr size_t hugePageSize = size_t(2) << 20;
+
+    struct Reservation {
+        uint8_t* mappingPtr = nullptr;
+        size_t mappingSize = 0;
+        uint8_t* dataPtr = nullptr;
+        size_t dataSize = 0;
+        size_t decommitGranularity = 0;
+        VirtualMemoryOptions options{};
+        std::atomic<size_t> decommittedBytes = {0};
+
+        ~Reservation() {
+            if (mappingPtr) { ::munmap(mappingPtr, mappingSize); }
+        }
+    };
+
+    std::shared_ptr<Reservation> reservation{};
+
+    VirtualMemoryContainer() = default;
+
+    explicit VirtualMemoryContainer(size_t size, const VirtualMemoryOptions& options = VirtualMemoryOptions()) {
+        if (!size) { return; }
+
+        size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t alignment = options.hugePages ? hugePageSize : pageSize;
+        size_t dataSize = (size + pageSize - 1) / pageSize * pageSize;
+        size_t mappingSize = dataSize + (options.hugePages ? hugePageSize : 0);
+
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+        flags |= MAP_NORESERVE;
+#endif
+
+        void* p = ::mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p == MAP_FAILED) { return; }
+
+        auto r = std::make_shared<Reservation>();
+        r->mappingPtr = static_cast<uint8_t*>(p);
+        r->mappingSize = mappingSize;
+        r->dataPtr = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(p) + alignment - 1) & ~uintptr_t(alignment - 1));
+        r->dataSize = size;
+        r->decommitGranularity = alignment;
+        r->options = options;
+
+#if defined(MADV_HUGEPAGE)
+        if (options.hugePages) { ::madvise(r->dataPtr, dataSize, MADV_HUGEPAGE); }
+#endif
+
+        reservation = std::move(r);
+        if (options.prefaultThreads) { prefault(options.prefaultThreads); }
+    }
+
+    uint8_t* data() const { return reservation ? reservation->dataPtr : nullptr; }
+    size_t size() const { return reservation ? reservation->dataSize : 0; }
+    bool empty() const { return !size(); }
+
+    //
+    // Commits every page up front, each thread touches its own slice. For latency-critical arenas that should not
+    // take page faults on their first allocations.
+    //
+
+    void prefault(size_t threadCount) const {
+        if (empty()) { return; }
+
+        size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t pageCount = (size() + pageSize - 1) / pageSize;
+        threadCount = std::max<size_t>(1, std::min(threadCount, pageCount));
+
+        auto touch = [this, pageSize, pageCount, threadCount](size_t t) {
+            volatile uint8_t* base = data();
+            for (size_t i = pageCount * t / threadCount; i < pageCount * (t + 1) / threadCount; ++i) {
+                base[i * pageSize] = base[i * pageSize];
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < threadCount; ++t) { threads.emplace_back(touch, t); }
+        touch(0);
+        for (auto& thread : threads) { thread.join(); }
+    }
+
+    //
+    // Called by FixedAllocator for every coalesced free range [freeOffset, freeOffset + freeSize) on the free paths.
+    // Only the whole pages of the free range that overlap the freed bytes are decommitted, the rest was handled when
+    // it became free.
+    //
+
+    void decommitFreeRange(size_t freeOffset, size_t freeSize, size_t freedOffset, size_t freedSize) const {
+        const Reservation& r = *reservation;
+        if (!r.options.decommitThreshold || freeSize < r.options.decommitThreshold) { return; }
+
+        const size_t granularity = r.decommitGranularity;
+        size_t first = std::max((freeOffset + granularity - 1) / granularity, freedOffset / granularity);
+        size_t last = std::min((freeOffset + freeSize) / granularity, (freedOffset + freedSize + granularity - 1) / granularity);
+        if (first >= last) { return; }
+
+        int advice = MADV_DONTNEED;
+#if defined(MADV_FREE)
+        if (r.options.lazyFree) { advice = MADV_FREE; }
+#endif
+
+        if (::madvise(r.dataPtr + first * granularity, (last - first) * granularity, advice) == 0) {
+            reservation->decommittedBytes.fetch_add((last - first) * granularity, std::memory_order_relaxed);
+        }
+    }
+
+    size_t decommittedBytes() const {
+        return reservation ? reservation->decommittedBytes.load(std::memory_order_relaxed) : 0;
+    }
+
+#if defined(__linux__)
+    //
+    // Committed bytes of the reservation as seen by the kernel (mincore), for tests and diagnostics.
+    //
+
+    size_t residentBytes() const {
+        if (empty()) { return 0; }
+
+        size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t pageCount = (size() + pageSize - 1) / pageSize;
+        std::vector<unsigned char> pages(pageCount);
+        if (::mincore(data(), pageCount * pageSize, pages.data()) != 0) { return 0; }
+
+        size_t residentPages = 0;
+        for (unsigned char page : pages) { residentPages += page & 1; }
+        return residentPages * pageSize;
+    }
+#endif
+};
+
+#endif
+
+}
@@ -1,7 +1,29 @@
 
 #include <TinyFixedAllocator.hh>
+#include <TinyFixedThreadCache.hh>
+#include <TinyFixedBlockPool.hh>
+#include <TinyFixedBitmapAllocator.hh>
+#include <TinyFixedInstrumentation.hh>
+#include <TinyFixedMemoryResource.hh>
+#include <TinyFixedPersistentArena.hh>
+#include <TinyFixedSharedMemory.hh>
+#include <TinyFixedHandleAllocator.hh>
+#include <TinyFixedSegmentedAllocator.hh>
+#include <TinyFixedLinearAllocator.hh>
+#include <TinyFixedOwnedAllocator.hh>
+#include <TinyFixedVirtualMemory.hh>
+#include <TinyFixedShardedAllocator.hh>
 #include <taskflow/taskflow.hpp>
 #include <gtest/gtest.h>
+#include <random>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
 
 namespace {
 
@@ -691,4 +713,1955 @@ TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorMegaTest) {
     }
 }
 
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorTlsfTest) {
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(1024 * 64, 0);
+
+    ByteSpan span(vectorBuffer.data(), vectorBuffer.size());
+    FixedAllocator<uint32_t, ByteSpan, FixedAllocatorTlsfRanges<uint32_t>> fixedAllocator(span);
+    DUMP_STATE(fixedAllocator.dumpState());
+
+    //
+    // Free lists live in band, the only side metadata are two bits per 16 bytes.
+    //
+
+    auto& store = fixedAllocator.freeBufferRanges;
+    EXPECT_LE((store.usedStarts.capacity() + store.usedEnds.capacity()) * sizeof(uint64_t), vectorBuffer.size() / 64 + 16);
+
+    std::mt19937 rng(42);
+    std::vector<void*> allocations = {};
+    for (size_t r = 0; r < 1024; ++r) {
+        if (allocations.empty() || rng() % 3) {
+            void* p = fixedAllocator.alloc(1 + rng() % 512); EXPECT_TRUE(fixedAllocator.good());
+            if (p) { allocations.push_back(p); }
+        } else {
+            size_t i = rng() % allocations.size();
+            EXPECT_NO_THROW(fixedAllocator.free(allocations[i])); EXPECT_TRUE(fixedAllocator.good());
+            allocations[i] = allocations.back();
+            allocations.pop_back();
+        }
+    }
+
+    void* _0 = allocations.front();
+    for (void* p : allocations) { EXPECT_NO_THROW(fixedAllocator.free(p)); EXPECT_TRUE(fixedAllocator.good()); }
+    EXPECT_ANY_THROW(fixedAllocator.free(_0)); EXPECT_TRUE(fixedAllocator.good());
+
+    DUMP_STATE(fixedAllocator.dumpState());
+    EXPECT_EQ(fixedAllocator.freeBufferRanges.size(), 1);
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+    EXPECT_EQ(fixedAllocator.totalOccupiedSpace(), 0);
+
+    //
+    // Blocks are rounded up to hold the in-band fields once free: header, size, two links and the footer.
+    //
+
+    void* tiny[3] = {fixedAllocator.alloc(1), fixedAllocator.alloc(1), fixedAllocator.alloc(1)};
+    EXPECT_EQ(fixedAllocator.totalOccupiedSpace(), 3 * 20);
+    EXPECT_EQ((uint8_t*)tiny[1] - (uint8_t*)tiny[0], 20);
+    EXPECT_NO_THROW(fixedAllocator.free(tiny[1])); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_ANY_THROW(fixedAllocator.free(tiny[1])); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_NO_THROW(fixedAllocator.free(tiny[0])); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_NO_THROW(fixedAllocator.free(tiny[2])); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+
+    //
+    // TLSF picks the ranges itself, a best-fit policy does not keep its size index.
+    //
+
+    using BestFitTlsfAllocator = FixedAllocator<uint32_t, ByteSpan, FixedAllocatorTlsfRanges<uint32_t>, defaults::DefaultExceptionPolicy,
+                                                defaults::DefaultSingleThreadedLockPolicy, defaults::BestFitPolicy>;
+    static_assert(std::is_same<BestFitTlsfAllocator::fit_index_type, defaults::FirstFitPolicy::Index<uint32_t>>::value,
+                  "TLSF does not maintain a fit index.");
+
+    //
+    // Exact fit of the whole buffer with uint16_t headers.
+    //
+
+    std::vector<uint8_t> smallBuffer = {};
+    smallBuffer.resize(4096, 0);
+
+    FixedAllocator<uint16_t, ByteSpan, FixedAllocatorTlsfRanges<uint16_t>> smallAllocator(ByteSpan(smallBuffer.data(), smallBuffer.size()));
+    auto _1 = smallAllocator.alloc(1022); EXPECT_TRUE(smallAllocator.good());
+    auto _2 = smallAllocator.alloc(1022); EXPECT_TRUE(smallAllocator.good());
+    auto _3 = smallAllocator.alloc(1022); EXPECT_TRUE(smallAllocator.good());
+    auto _4 = smallAllocator.alloc(1022); EXPECT_TRUE(smallAllocator.good());
+    EXPECT_NE(nullptr, _1);
+    EXPECT_NE(nullptr, _2);
+    EXPECT_NE(nullptr, _3);
+    EXPECT_NE(nullptr, _4);
+    EXPECT_EQ(nullptr, smallAllocator.alloc(1));
+    EXPECT_EQ(smallAllocator.totalFreeSpace(), 0);
+
+    EXPECT_NO_THROW(smallAllocator.free(_1)); EXPECT_TRUE(smallAllocator.good());
+    EXPECT_NO_THROW(smallAllocator.free(_3)); EXPECT_TRUE(smallAllocator.good());
+    EXPECT_NO_THROW(smallAllocator.free(_2)); EXPECT_TRUE(smallAllocator.good());
+    EXPECT_ANY_THROW(smallAllocator.free(_2)); EXPECT_TRUE(smallAllocator.good());
+    EXPECT_NO_THROW(smallAllocator.free(_4)); EXPECT_TRUE(smallAllocator.good());
+    EXPECT_EQ(smallAllocator.totalFreeSpace(), smallBuffer.size());
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorRangeTreeTest) {
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(1024 * 64, 0);
+
+    std::vector<uint8_t> treeBuffer = {};
+    treeBuffer.resize(vectorBuffer.size(), 0);
+
+    FixedAllocator<uint32_t, ByteSpan> vectorAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+    FixedAllocator<uint32_t, ByteSpan, FixedAllocatorRangeTree<uint32_t>> treeAllocator(ByteSpan(treeBuffer.data(), treeBuffer.size()));
+
+    //
+    // Both stores are first-fit, so the same sequence must produce the same offsets.
+    //
+
+    std::mt19937 rng(7);
+    std::vector<std::pair<void*, void*>> allocations = {};
+    for (size_t r = 0; r < 4096; ++r) {
+        if (allocations.empty() || rng() % 2) {
+            uint32_t size = 1 + rng() % 700;
+            void* v = vectorAllocator.alloc(size); EXPECT_TRUE(vectorAllocator.good());
+            void* t = treeAllocator.alloc(size); EXPECT_TRUE(treeAllocator.good());
+            EXPECT_EQ(v != nullptr, t != nullptr);
+            if (v && t) {
+                EXPECT_EQ((uint8_t*)v - vectorBuffer.data(), (uint8_t*)t - treeBuffer.data());
+                allocations.emplace_back(v, t);
+            }
+        } else {
+            size_t i = rng() % allocations.size();
+            EXPECT_NO_THROW(vectorAllocator.free(allocations[i].first)); EXPECT_TRUE(vectorAllocator.good());
+            EXPECT_NO_THROW(treeAllocator.free(allocations[i].second)); EXPECT_TRUE(treeAllocator.good());
+            allocations[i] = allocations.back();
+            allocations.pop_back();
+        }
+
+        EXPECT_EQ(vectorAllocator.totalFreeSpace(), treeAllocator.totalFreeSpace());
+        EXPECT_EQ(vectorAllocator.freeBufferRanges.size(), treeAllocator.freeBufferRanges.size());
+    }
+
+    void* _0 = allocations.front().second;
+    for (auto& p : allocations) { EXPECT_NO_THROW(treeAllocator.free(p.second)); EXPECT_TRUE(treeAllocator.good()); }
+    EXPECT_ANY_THROW(treeAllocator.free(_0)); EXPECT_TRUE(treeAllocator.good());
+
+    DUMP_STATE(treeAllocator.dumpState());
+    EXPECT_EQ(treeAllocator.freeBufferRanges.size(), 1);
+    EXPECT_EQ(treeAllocator.totalFreeSpace(), treeBuffer.size());
+    EXPECT_EQ(treeAllocator.totalOccupiedSpace(), 0);
+}
+
+template <typename RangeVectorType, typename FitPolicy>
+using FitTestAllocator = FixedAllocator<uint32_t,
+                                        ByteSpan,
+                                        RangeVectorType,
+                                        defaults::DefaultExceptionPolicy,
+                                        defaults::DefaultSingleThreadedLockPolicy,
+                                        FitPolicy>;
+
+template <typename RangeVectorType, typename BlockFormat, typename ContainerType = ByteSpan>
+using FormatTestAllocator = FixedAllocator<uint32_t,
+                                           ContainerType,
+                                           RangeVectorType,
+                                           defaults::DefaultExceptionPolicy,
+                                           defaults::DefaultSingleThreadedLockPolicy,
+                                           defaults::FirstFitPolicy,
+                                           BlockFormat>;
+
+//
+// 64 KB buffer with a FormatTestAllocator over it, shared by the tests that run over every store and block format.
+//
+
+template <typename RangeVectorType, typename BlockFormat>
+struct FormatTestArena {
+    std::vector<uint8_t> vectorBuffer = std::vector<uint8_t>(1024 * 64, 0);
+    FormatTestAllocator<RangeVectorType, BlockFormat> fixedAllocator{ByteSpan(vectorBuffer.data(), vectorBuffer.size())};
+};
+
+template <typename RangeVectorType, typename FitPolicy>
+void fitPolicyStressTest(uint32_t seed) {
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(1024 * 64, 0);
+
+    FitTestAllocator<RangeVectorType, FitPolicy> fixedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+
+    std::mt19937 rng(seed);
+    std::vector<void*> allocations = {};
+    for (size_t r = 0; r < 4096; ++r) {
+        if (allocations.empty() || rng() % 2) {
+            void* p = fixedAllocator.alloc(1 + rng() % 700); EXPECT_TRUE(fixedAllocator.good());
+            if (p) { allocations.push_back(p); }
+        } else {
+            size_t i = rng() % allocations.size();
+            EXPECT_NO_THROW(fixedAllocator.free(allocations[i])); EXPECT_TRUE(fixedAllocator.good());
+            allocations[i] = allocations.back();
+            allocations.pop_back();
+        }
+    }
+
+    for (void* p : allocations) { EXPECT_NO_THROW(fixedAllocator.free(p)); EXPECT_TRUE(fixedAllocator.good()); }
+    EXPECT_EQ(fixedAllocator.freeBufferRanges.size(), 1);
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+}
+
+template <typename RangeVectorType, typename FitPolicy>
+std::vector<size_t> fitPolicyPlacementTest() {
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(4096, 0);
+
+    FitTestAllocator<RangeVectorType, FitPolicy> fixedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+
+    //
+    // Leave free ranges {0,1280}, {1536,512} and {3072,1024}, chunks include the 4 byte header.
+    //
+
+    auto _0 = fixedAllocator.alloc(1020);
+    auto _1 = fixedAllocator.alloc(252);
+    auto _2 = fixedAllocator.alloc(252);
+    auto _3 = fixedAllocator.alloc(508);
+    auto _4 = fixedAllocator.alloc(1020);
+    EXPECT_NE(nullptr, _4);
+    EXPECT_NO_THROW(fixedAllocator.free(_0));
+    EXPECT_NO_THROW(fixedAllocator.free(_1));
+    EXPECT_NO_THROW(fixedAllocator.free(_3));
+    EXPECT_TRUE(fixedAllocator.good());
+
+    std::vector<size_t> offsets = {};
+    for (size_t i = 0; i < 3; ++i) {
+        auto p = reinterpret_cast<uint8_t*>(fixedAllocator.alloc(124));
+        EXPECT_NE(nullptr, p); EXPECT_TRUE(fixedAllocator.good());
+        offsets.push_back(p - vectorBuffer.data() - 4);
+    }
+
+    (void)_2;
+    return offsets;
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorFitPolicyTest) {
+    using RangeVector = std::vector<FixedAllocatorRange<uint32_t>>;
+    using RangeTree = FixedAllocatorRangeTree<uint32_t>;
+
+    fitPolicyStressTest<RangeVector, defaults::FirstFitPolicy>(1);
+    fitPolicyStressTest<RangeVector, defaults::BestFitPolicy>(2);
+    fitPolicyStressTest<RangeVector, defaults::WorstFitPolicy>(3);
+    fitPolicyStressTest<RangeVector, defaults::NextFitPolicy>(4);
+    fitPolicyStressTest<RangeTree, defaults::FirstFitPolicy>(5);
+    fitPolicyStressTest<RangeTree, defaults::BestFitPolicy>(6);
+    fitPolicyStressTest<RangeTree, defaults::WorstFitPolicy>(7);
+    fitPolicyStressTest<RangeTree, defaults::NextFitPolicy>(8);
+
+    EXPECT_EQ((fitPolicyPlacementTest<RangeVector, defaults::FirstFitPolicy>()), (std::vector<size_t>{0, 128, 256}));
+    EXPECT_EQ((fitPolicyPlacementTest<RangeTree, defaults::FirstFitPolicy>()), (std::vector<size_t>{0, 128, 256}));
+    EXPECT_EQ((fitPolicyPlacementTest<RangeVector, defaults::BestFitPolicy>()), (std::vector<size_t>{1536, 1664, 1792}));
+    EXPECT_EQ((fitPolicyPlacementTest<RangeTree, defaults::BestFitPolicy>()), (std::vector<size_t>{1536, 1664, 1792}));
+    EXPECT_EQ((fitPolicyPlacementTest<RangeVector, defaults::WorstFitPolicy>()), (std::vector<size_t>{0, 128, 256}));
+    EXPECT_EQ((fitPolicyPlacementTest<RangeTree, defaults::WorstFitPolicy>()), (std::vector<size_t>{0, 128, 256}));
+    EXPECT_EQ((fitPolicyPlacementTest<RangeVector, defaults::NextFitPolicy>()), (std::vector<size_t>{3072, 3200, 3328}));
+    EXPECT_EQ((fitPolicyPlacementTest<RangeTree, defaults::NextFitPolicy>()), (std::vector<size_t>{3072, 3200, 3328}));
+}
+
+template <typename SizeType, typename RangeVectorType, typename FitPolicy>
+void alignedAllocTest(uint32_t seed) {
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(1024 * 32 + 3, 0);
+
+    ByteSpan span(vectorBuffer.data() + 3, vectorBuffer.size() - 3);
+    FixedAllocator<SizeType,
+                   ByteSpan,
+                   RangeVectorType,
+                   defaults::DefaultExceptionPolicy,
+                   defaults::DefaultSingleThreadedLockPolicy,
+                   FitPolicy> fixedAllocator(span);
+
+    std::mt19937 rng(seed);
+    std::vector<void*> allocations = {};
+    for (size_t r = 0; r < 2048; ++r) {
+        if (allocations.empty() || rng() % 2) {
+            SizeType alignment = SizeType(1) << (rng() % 13);
+            SizeType size = 1 + rng() % 300;
+            void* p = fixedAllocator.allocAligned(size, alignment); EXPECT_TRUE(fixedAllocator.good());
+            if (p) {
+                EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignment, 0);
+                memset(p, 0xcd, size);
+                allocations.push_back(p);
+            }
+        } else {
+            size_t i = rng() % allocations.size();
+            EXPECT_NO_THROW(fixedAllocator.free(allocations[i])); EXPECT_TRUE(fixedAllocator.good());
+            allocations[i] = allocations.back();
+            allocations.pop_back();
+        }
+    }
+
+    void* _0 = allocations.front();
+    for (void* p : allocations) { EXPECT_NO_THROW(fixedAllocator.free(p)); EXPECT_TRUE(fixedAllocator.good()); }
+    EXPECT_ANY_THROW(fixedAllocator.free(_0)); EXPECT_TRUE(fixedAllocator.good());
+
+    EXPECT_EQ(fixedAllocator.freeBufferRanges.size(), 1);
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), span.size());
+    EXPECT_EQ(fixedAllocator.totalOccupiedSpace(), 0);
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorAlignedTest) {
+    alignedAllocTest<uint16_t, std::vector<FixedAllocatorRange<uint16_t>>, defaults::FirstFitPolicy>(1);
+    alignedAllocTest<uint32_t, std::vector<FixedAllocatorRange<uint32_t>>, defaults::FirstFitPolicy>(2);
+    alignedAllocTest<uint64_t, std::vector<FixedAllocatorRange<uint64_t>>, defaults::NextFitPolicy>(3);
+    alignedAllocTest<uint32_t, FixedAllocatorRangeTree<uint32_t>, defaults::BestFitPolicy>(4);
+    alignedAllocTest<uint32_t, FixedAllocatorRangeTree<uint32_t>, defaults::WorstFitPolicy>(5);
+    alignedAllocTest<uint32_t, FixedAllocatorTlsfRanges<uint32_t>, defaults::FirstFitPolicy>(6);
+
+    //
+    // Padding in front of an aligned block goes back to the free list.
+    //
+
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(4096 + 64, 0);
+
+    uint8_t* alignedData = vectorBuffer.data() + (64 - reinterpret_cast<uintptr_t>(vectorBuffer.data()) % 64);
+    FixedAllocator<uint32_t, ByteSpan> fixedAllocator(ByteSpan(alignedData, 4096));
+
+    auto _0 = fixedAllocator.alloc(8); EXPECT_TRUE(fixedAllocator.good());
+    auto _1 = fixedAllocator.allocAligned(64, 64); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(_0, alignedData + 4);
+    EXPECT_EQ(_1, alignedData + 64);
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), 4096 - 12 - 68);
+
+    auto _2 = fixedAllocator.alloc(44); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(_2, alignedData + 16);
+    EXPECT_EQ(fixedAllocator.freeBufferRanges.size(), 1);
+
+    EXPECT_NO_THROW(fixedAllocator.free(_1)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_NO_THROW(fixedAllocator.free(_0)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_NO_THROW(fixedAllocator.free(_2)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), 4096);
+}
+
+template <typename SizeType, typename RangeVectorType, typename FitPolicy>
+void boundaryTagTest(uint32_t seed) {
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(1024 * 16 + 1, 0);
+
+    ByteSpan span(vectorBuffer.data() + 1, vectorBuffer.size() - 1);
+    FixedAllocator<SizeType,
+                   ByteSpan,
+                   RangeVectorType,
+                   defaults::DefaultExceptionPolicy,
+                   defaults::DefaultSingleThreadedLockPolicy,
+                   FitPolicy,
+                   defaults::BoundaryTagBlockFormat> fixedAllocator(span);
+
+    std::mt19937 rng(seed);
+    std::vector<std::pair<void*, SizeType>> allocations = {};
+    for (size_t r = 0; r < 4096; ++r) {
+        if (allocations.empty() || rng() % 2) {
+            SizeType alignment = SizeType(1) << (rng() % 7);
+            SizeType size = 1 + rng() % 200;
+            void* p = fixedAllocator.allocAligned(size, alignment); EXPECT_TRUE(fixedAllocator.good());
+            if (p) {
+                EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignment, 0);
+                EXPECT_GE(fixedAllocator.allocationSize(p), size);
+                memset(p, 0xcd, size);
+                allocations.emplace_back(p, size);
+            }
+        } else {
+            size_t i = rng() % allocations.size();
+            EXPECT_NO_THROW(fixedAllocator.free(allocations[i].first)); EXPECT_TRUE(fixedAllocator.good());
+            EXPECT_ANY_THROW(fixedAllocator.free(allocations[i].first)); EXPECT_TRUE(fixedAllocator.good());
+            allocations[i] = allocations.back();
+            allocations.pop_back();
+        }
+    }
+
+    for (auto& a : allocations) { EXPECT_NO_THROW(fixedAllocator.free(a.first)); EXPECT_TRUE(fixedAllocator.good()); }
+
+    EXPECT_EQ(fixedAllocator.freeBufferRanges.size(), 1);
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), span.size());
+    EXPECT_EQ(fixedAllocator.totalOccupiedSpace(), 0);
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorBoundaryTagTest) {
+    boundaryTagTest<uint16_t, std::vector<FixedAllocatorRange<uint16_t>>, defaults::FirstFitPolicy>(1);
+    boundaryTagTest<uint32_t, std::vector<FixedAllocatorRange<uint32_t>>, defaults::BestFitPolicy>(2);
+    boundaryTagTest<uint64_t, FixedAllocatorRangeTree<uint64_t>, defaults::NextFitPolicy>(3);
+    boundaryTagTest<uint32_t, FixedAllocatorTlsfRanges<uint32_t>, defaults::FirstFitPolicy>(4);
+
+    //
+    // Tags at both ends, tails too small for a free block are absorbed into the allocation.
+    //
+
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(64, 0);
+
+    FixedAllocator<uint32_t,
+                   ByteSpan,
+                   std::vector<FixedAllocatorRange<uint32_t>>,
+                   defaults::DefaultExceptionPolicy,
+                   defaults::DefaultSingleThreadedLockPolicy,
+                   defaults::FirstFitPolicy,
+                   defaults::BoundaryTagBlockFormat> fixedAllocator(ByteSpan(vectorBuffer.data(), 64));
+
+    auto _0 = fixedAllocator.alloc(8); EXPECT_TRUE(fixedAllocator.good());
+    auto _1 = fixedAllocator.alloc(8); EXPECT_TRUE(fixedAllocator.good());
+    auto _2 = fixedAllocator.alloc(20); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(_0, vectorBuffer.data() + 4);
+    EXPECT_EQ(_1, vectorBuffer.data() + 20);
+    EXPECT_EQ(_2, vectorBuffer.data() + 36);
+    EXPECT_EQ(fixedAllocator.allocationSize(_2), 24);
+    EXPECT_EQ(fixedAllocator.freeBufferRanges.size(), 0);
+
+    EXPECT_NO_THROW(fixedAllocator.free(_0)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_NO_THROW(fixedAllocator.free(_2)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.freeBufferRanges.size(), 2);
+    EXPECT_NO_THROW(fixedAllocator.free(_1)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.freeBufferRanges.size(), 1);
+    EXPECT_ANY_THROW(fixedAllocator.free(_1)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), 64);
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorThreadCacheTest) {
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(1024 * 1024, 0);
+
+    using MultiThreadedAllocator = FixedAllocator<uint32_t,
+                                                  ByteSpan,
+                                                  std::vector<FixedAllocatorRange<uint32_t>>,
+                                                  defaults::DefaultExceptionPolicy,
+                                                  defaults::DefaultMultiThreadedLockPolicy>;
+
+    MultiThreadedAllocator fixedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+
+    {
+        FixedAllocatorThreadCache<MultiThreadedAllocator, 8> cache(fixedAllocator);
+
+        void* _0 = cache.alloc(20); EXPECT_TRUE(fixedAllocator.good());
+        EXPECT_EQ(fixedAllocator.allocationSize(_0), 32);
+        EXPECT_EQ(cache.cachedBlockCount(), 3);
+
+        EXPECT_NO_THROW(cache.free(_0));
+        EXPECT_EQ(cache.cachedBlockCount(), 4);
+        EXPECT_EQ(cache.alloc(32), _0);
+
+        void* _1 = cache.alloc(4000);
+        EXPECT_EQ(fixedAllocator.allocationSize(_1), 4000);
+        EXPECT_NO_THROW(cache.free(_1));
+        EXPECT_NO_THROW(cache.free(_0));
+
+        cache.flush();
+        EXPECT_EQ(cache.cachedBlockCount(), 0);
+        EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+
+        //
+        // An overflowing magazine returns its oldest half and keeps the recently freed blocks.
+        //
+
+        void* blocks[9] = {};
+        for (auto& b : blocks) { b = fixedAllocator.alloc(32); }
+        for (auto b : blocks) { EXPECT_NO_THROW(cache.free(b)); }
+        EXPECT_EQ(cache.cachedBlockCount(), 5);
+        EXPECT_EQ(fixedAllocator.totalOccupiedSpace(), 5 * (32 + fixedAllocator.headerSize));
+        for (size_t i = 9; i-- > 4;) { EXPECT_EQ(cache.alloc(32), blocks[i]); }
+
+        for (size_t i = 4; i < 9; ++i) { EXPECT_NO_THROW(cache.free(blocks[i])); }
+        cache.flush();
+        EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+    }
+
+    //
+    // Blocks are freed on other threads than the ones that allocated them.
+    //
+
+    std::vector<void*> sharedBlocks[4] = {};
+    std::vector<std::thread> threads = {};
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            FixedAllocatorThreadCache<MultiThreadedAllocator> cache(fixedAllocator);
+
+            std::mt19937 rng(static_cast<uint32_t>(t));
+            std::vector<void*> allocations = {};
+            for (size_t r = 0; r < 4096; ++r) {
+                if (allocations.empty() || rng() % 2) {
+                    uint32_t size = 1 + rng() % 1500;
+                    void* p = cache.alloc(size);
+                    if (p) { memset(p, int(t), size); allocations.push_back(p); }
+                } else {
+                    size_t i = rng() % allocations.size();
+                    cache.free(allocations[i]);
+                    allocations[i] = allocations.back();
+                    allocations.pop_back();
+                }
+            }
+
+            sharedBlocks[t] = std::move(allocations);
+        });
+    }
+
+    for (auto& thread : threads) { thread.join(); }
+    threads.clear();
+
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            FixedAllocatorThreadCache<MultiThreadedAllocator> cache(fixedAllocator);
+            for (void* p : sharedBlocks[(t + 1) % 4]) { cache.free(p); }
+        });
+    }
+
+    for (auto& thread : threads) { thread.join(); }
+
+    EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+    EXPECT_EQ(fixedAllocator.totalOccupiedSpace(), 0);
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedBlockPoolTest) {
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(1024 * 256, 0);
+
+    FixedAllocator<uint32_t, ByteSpan> fixedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+    ByteSpan poolSpan = fixedAllocator.allocByteSpanAligned(64 * 1024, 64);
+    EXPECT_FALSE(poolSpan.empty());
+
+    FixedBlockPool<64, 64> blockPool(poolSpan);
+    EXPECT_EQ(blockPool.capacity(), 1024);
+    EXPECT_ANY_THROW(blockPool.free(poolSpan.data() + 3));
+    EXPECT_ANY_THROW(blockPool.free(poolSpan.data() + poolSpan.size()));
+
+    //
+    // Threads keep a few blocks at a time and check nobody else wrote into them.
+    //
+
+    std::atomic<bool> overlapped = {false};
+    std::vector<std::thread> threads = {};
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            std::vector<uint8_t*> blocks = {};
+            for (size_t r = 0; r < 1024 * 16; ++r) {
+                if (blocks.size() < 16) {
+                    auto p = reinterpret_cast<uint8_t*>(blockPool.alloc());
+                    if (p) { memset(p, int(t + 1), 64); blocks.push_back(p); }
+                }
+
+                if (blocks.size() >= 16 || (r & 1)) {
+                    if (blocks.empty()) { continue; }
+                    auto p = blocks.back();
+                    blocks.pop_back();
+                    for (size_t i = 0; i < 64; ++i) { if (p[i] != t + 1) { overlapped = true; } }
+                    blockPool.free(p);
+                }
+            }
+
+            for (auto p : blocks) { blockPool.free(p); }
+        });
+    }
+
+    for (auto& thread : threads) { thread.join(); }
+    EXPECT_FALSE(overlapped);
+
+    std::vector<void*> blocks = {};
+    while (void* p = blockPool.alloc()) {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % 64, 0);
+        blocks.push_back(p);
+    }
+
+    EXPECT_EQ(blocks.size(), blockPool.capacity());
+    std::sort(blocks.begin(), blocks.end());
+    EXPECT_EQ(std::unique(blocks.begin(), blocks.end()), blocks.end());
+
+    for (void* p : blocks) { EXPECT_NO_THROW(blockPool.free(p)); }
+    EXPECT_NO_THROW(fixedAllocator.free(poolSpan.data()));
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+}
+
+template <typename LockPolicy>
+uint64_t lockPolicyStressTest() {
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(1024 * 1024, 0);
+
+    FixedAllocator<uint32_t,
+                   ByteSpan,
+                   std::vector<FixedAllocatorRange<uint32_t>>,
+                   defaults::DefaultExceptionPolicy,
+                   LockPolicy> fixedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+
+    std::vector<std::thread> threads = {};
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 rng(static_cast<uint32_t>(t));
+            std::vector<void*> allocations = {};
+            for (size_t r = 0; r < 4096; ++r) {
+                if (allocations.empty() || rng() % 2) {
+                    void* p = fixedAllocator.alloc(1 + rng() % 256);
+                    if (p) { allocations.push_back(p); }
+                } else {
+                    size_t i = rng() % allocations.size();
+                    EXPECT_NO_THROW(fixedAllocator.free(allocations[i]));
+                    allocations[i] = allocations.back();
+                    allocations.pop_back();
+                }
+
+                if (!(r % 64)) { EXPECT_TRUE(fixedAllocator.good()); }
+            }
+
+            for (void* p : allocations) { EXPECT_NO_THROW(fixedAllocator.free(p)); }
+        });
+    }
+
+    for (auto& thread : threads) { thread.join(); }
+
+    EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+    return fixedAllocator.lock.contentions();
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorLockPolicyTest) {
+    lockPolicyStressTest<defaults::BackoffSpinLockPolicy>();
+    lockPolicyStressTest<defaults::SharedSpinLockPolicy>();
+    lockPolicyStressTest<defaults::FutexLockPolicy>();
+
+    //
+    // Readers share the lock, a writer waits for all of them.
+    //
+
+    defaults::SharedSpinLock sharedLock;
+    sharedLock.lock_shared();
+    sharedLock.lock_shared();
+
+    std::atomic<bool> writerEntered = {false};
+    std::thread writer([&]() {
+        sharedLock.lock();
+        writerEntered = true;
+        sharedLock.unlock();
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_FALSE(writerEntered);
+    sharedLock.unlock_shared();
+    sharedLock.unlock_shared();
+    writer.join();
+
+    EXPECT_TRUE(writerEntered);
+    EXPECT_EQ(sharedLock.contentions(), 1);
+    EXPECT_EQ(sharedLock.state.load(), 0);
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyShardedFixedAllocatorTest) {
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(1024 * 1024 + 7, 0);
+
+    using ShardAllocator = FixedAllocator<uint32_t,
+                                          ByteSpan,
+                                          std::vector<FixedAllocatorRange<uint32_t>>,
+                                          defaults::DefaultExceptionPolicy,
+                                          defaults::BackoffSpinLockPolicy>;
+
+    ShardedFixedAllocator<ShardAllocator> shardedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()), 4);
+    EXPECT_EQ(shardedAllocator.shards.size(), 4);
+    EXPECT_EQ(shardedAllocator.totalFreeSpace(), vectorBuffer.size());
+
+    //
+    // One thread drains its home shard and keeps going on the neighbours.
+    //
+
+    std::vector<void*> blocks = {};
+    while (void* p = shardedAllocator.alloc(60 * 1024)) { blocks.push_back(p); }
+    EXPECT_EQ(blocks.size(), 16);
+
+    std::vector<size_t> blocksPerShard(4, 0);
+    for (void* p : blocks) { ++blocksPerShard[shardedAllocator.shardIndexOf(p)]; }
+    EXPECT_EQ(blocksPerShard, (std::vector<size_t>{4, 4, 4, 4}));
+
+    for (void* p : blocks) { EXPECT_NO_THROW(shardedAllocator.free(p)); }
+    EXPECT_ANY_THROW(shardedAllocator.free(vectorBuffer.data() + vectorBuffer.size()));
+    EXPECT_ANY_THROW(shardedAllocator.free(blocks.back()));
+    EXPECT_EQ(shardedAllocator.totalFreeSpace(), vectorBuffer.size());
+
+    //
+    // Blocks are freed on other threads than the ones that allocated them.
+    //
+
+    std::vector<void*> sharedBlocks[4] = {};
+    std::vector<std::thread> threads = {};
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 rng(static_cast<uint32_t>(t));
+            std::vector<void*> allocations = {};
+            for (size_t r = 0; r < 4096; ++r) {
+                if (allocations.empty() || rng() % 2) {
+                    void* p = shardedAllocator.alloc(1 + rng() % 1024);
+                    if (p) { allocations.push_back(p); }
+                } else {
+                    size_t i = rng() % allocations.size();
+                    EXPECT_NO_THROW(shardedAllocator.free(allocations[i]));
+                    allocations[i] = allocations.back();
+                    allocations.pop_back();
+                }
+            }
+
+            sharedBlocks[t] = std::move(allocations);
+        });
+    }
+
+    for (auto& thread : threads) { thread.join(); }
+    threads.clear();
+
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (void* p : sharedBlocks[(t + 1) % 4]) { EXPECT_NO_THROW(shardedAllocator.free(p)); }
+        });
+    }
+
+    for (auto& thread : threads) { thread.join(); }
+
+    EXPECT_TRUE(shardedAllocator.good());
+    EXPECT_EQ(shardedAllocator.totalFreeSpace(), vectorBuffer.size());
+    EXPECT_EQ(shardedAllocator.totalOccupiedSpace(), 0);
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyBitmapFixedAllocatorTest) {
+    std::vector<uint8_t> vectorBuffer = {};
+    vectorBuffer.resize(1024 * 64 + 5, 0);
+
+    using BitmapAllocator = BitmapFixedAllocator<FixedAllocator<uint32_t, ByteSpan>>;
+    ByteSpan span(vectorBuffer.data() + 5, vectorBuffer.size() - 5);
+    BitmapAllocator bitmapAllocator(span, 1024 * 8);
+    EXPECT_EQ(bitmapAllocator.granuleCount, 1024 * 8 / 16);
+    EXPECT_GT(bitmapAllocator.capacity() + 16, span.size());
+    EXPECT_EQ(bitmapAllocator.totalFreeSpace(), bitmapAllocator.capacity());
+
+    //
+    // Small blocks are packed into granules without headers, large ones go to the range allocator.
+    //
+
+    auto _0 = bitmapAllocator.alloc(1); EXPECT_TRUE(bitmapAllocator.good());
+    auto _1 = bitmapAllocator.alloc(17); EXPECT_TRUE(bitmapAllocator.good());
+    auto _2 = bitmapAllocator.alloc(16); EXPECT_TRUE(bitmapAllocator.good());
+    auto _3 = bitmapAllocator.alloc(129); EXPECT_TRUE(bitmapAllocator.good());
+    auto _4 = bitmapAllocator.allocAligned(8, 64); EXPECT_TRUE(bitmapAllocator.good());
+    EXPECT_EQ(_0, bitmapAllocator.bitmapData);
+    EXPECT_EQ(_1, bitmapAllocator.bitmapData + 16);
+    EXPECT_EQ(_2, bitmapAllocator.bitmapData + 48);
+    EXPECT_FALSE(bitmapAllocator.ownsBitmap(_3));
+    EXPECT_FALSE(bitmapAllocator.ownsBitmap(_4));
+    EXPECT_EQ(bitmapAllocator.allocationSize(_1), 32);
+
+    EXPECT_ANY_THROW(bitmapAllocator.free(reinterpret_cast<uint8_t*>(_1) + 16)); EXPECT_TRUE(bitmapAllocator.good());
+    EXPECT_NO_THROW(bitmapAllocator.free(_1)); EXPECT_TRUE(bitmapAllocator.good());
+    EXPECT_ANY_THROW(bitmapAllocator.free(_1)); EXPECT_TRUE(bitmapAllocator.good());
+    EXPECT_EQ(bitmapAllocator.alloc(30), _1);
+
+    for (void* p : {_0, _1, _2, _3, _4}) { EXPECT_NO_THROW(bitmapAllocator.free(p)); EXPECT_TRUE(bitmapAllocator.good()); }
+    EXPECT_EQ(bitmapAllocator.totalFreeSpace(), bitmapAllocator.capacity());
+
+    //
+    // Random runs across word boundaries, blocks must never overlap.
+    //
+
+    std::mt19937 rng(42);
+    std::vector<std::pair<uint8_t*, uint32_t>> allocations = {};
+    for (size_t r = 0; r < 8192; ++r) {
+        if (allocations.empty() || rng() % 3) {
+            uint32_t size = rng() % 8 ? 1 + rng() % 128 : 1 + rng() % 1024;
+            auto p = reinterpret_cast<uint8_t*>(bitmapAllocator.alloc(size));
+            if (p) {
+                memset(p, uint8_t(allocations.size()), size);
+                allocations.emplace_back(p, size);
+            }
+        } else {
+            size_t i = rng() % allocations.size();
+            uint8_t* p = allocations[i].first;
+            for (uint32_t j = 0; j < allocations[i].second; ++j) { EXPECT_EQ(p[j], uint8_t(i)); }
+
+            EXPECT_NO_THROW(bitmapAllocator.free(p)); EXPECT_TRUE(bitmapAllocator.good());
+            allocations[i] = allocations.back();
+            allocations.pop_back();
+            if (i < allocations.size()) { memset(allocations[i].first, uint8_t(i), allocations[i].second); }
+        }
+    }
+
+    for (auto& a : allocations) { EXPECT_NO_THROW(bitmapAllocator.free(a.first)); EXPECT_TRUE(bitmapAllocator.good()); }
+    EXPECT_EQ(bitmapAllocator.freeGranuleCount(), bitmapAllocator.granuleCount);
+    EXPECT_EQ(bitmapAllocator.totalFreeSpace(), bitmapAllocator.capacity());
+    EXPECT_EQ(bitmapAllocator.totalOccupiedSpace(), 0);
+}
+
+template <typename RangeVectorType, typename BlockFormat>
+void batchTest(uint32_t seed) {
+    FormatTestArena<RangeVectorType, BlockFormat> batchArena;
+    FormatTestArena<RangeVectorType, BlockFormat> singleArena;
+    auto& batchBuffer = batchArena.vectorBuffer;
+    auto& singleBuffer = singleArena.vectorBuffer;
+    auto& batchAllocator = batchArena.fixedAllocator;
+    auto& singleAllocator = singleArena.fixedAllocator;
+
+    //
+    // Batches must leave exactly the same free ranges as the same blocks freed one by one.
+    // TLSF hands out blocks in free-list order, which depends on the order of frees, so only its totals are compared.
+    //
+
+    constexpr bool sameOffsets = !std::is_same<RangeVectorType, FixedAllocatorTlsfRanges<uint32_t>>::value;
+
+    std::mt19937 rng(seed);
+    std::vector<void*> batchAllocations = {};
+    std::vector<void*> singleAllocations = {};
+    for (size_t r = 0; r < 256; ++r) {
+        uint32_t sizes[32] = {};
+        void* batchPtrs[32] = {};
+        size_t count = 1 + rng() % 32;
+        for (size_t i = 0; i < count; ++i) { sizes[i] = 1 + rng() % 256; }
+
+        size_t allocatedCount = batchAllocator.allocBatch(sizes, count, batchPtrs); EXPECT_TRUE(batchAllocator.good());
+        for (size_t i = 0; i < count; ++i) {
+            void* p = singleAllocator.alloc(sizes[i]);
+            if (sameOffsets) { EXPECT_EQ(p != nullptr, batchPtrs[i] != nullptr); }
+            if (!p || !batchPtrs[i]) {
+                if (p) { singleAllocator.free(p); }
+                if (batchPtrs[i]) { --allocatedCount; batchAllocator.free(batchPtrs[i]); }
+                continue;
+            }
+
+            if (sameOffsets) {
+                EXPECT_EQ(reinterpret_cast<uint8_t*>(p) - singleBuffer.data(), reinterpret_cast<uint8_t*>(batchPtrs[i]) - batchBuffer.data());
+            }
+
+            batchAllocations.push_back(batchPtrs[i]);
+            singleAllocations.push_back(p);
+            --allocatedCount;
+        }
+
+        EXPECT_EQ(allocatedCount, 0);
+
+        std::vector<void*> freedPtrs = {};
+        for (size_t n = rng() % 40; n && !batchAllocations.empty(); --n) {
+            size_t i = rng() % batchAllocations.size();
+            freedPtrs.push_back(batchAllocations[i]);
+            EXPECT_NO_THROW(singleAllocator.free(singleAllocations[i]));
+
+            batchAllocations[i] = batchAllocations.back();
+            batchAllocations.pop_back();
+            singleAllocations[i] = singleAllocations.back();
+            singleAllocations.pop_back();
+        }
+
+        freedPtrs.push_back(nullptr);
+        EXPECT_NO_THROW(batchAllocator.freeBatch(freedPtrs.data(), freedPtrs.size())); EXPECT_TRUE(batchAllocator.good());
+        if (sameOffsets) {
+            EXPECT_EQ(batchAllocator.freeBufferRanges.size(), singleAllocator.freeBufferRanges.size());
+            EXPECT_EQ(batchAllocator.totalFreeSpace(), singleAllocator.totalFreeSpace());
+        }
+    }
+
+    //
+    // A batch with a block freed twice is rejected as a whole.
+    //
+
+    size_t freeSpace = batchAllocator.totalFreeSpace();
+    if (batchAllocations.size() >= 2) {
+        void* invalidBatch[] = {batchAllocations[0], batchAllocations[1], batchAllocations[0]};
+        EXPECT_ANY_THROW(batchAllocator.freeBatch(invalidBatch, 3)); EXPECT_TRUE(batchAllocator.good());
+        EXPECT_EQ(batchAllocator.totalFreeSpace(), freeSpace);
+    }
+
+    EXPECT_NO_THROW(batchAllocator.freeBatch(batchAllocations.data(), batchAllocations.size())); EXPECT_TRUE(batchAllocator.good());
+    EXPECT_EQ(batchAllocator.freeBufferRanges.size(), 1);
+    EXPECT_EQ(batchAllocator.totalFreeSpace(), batchBuffer.size());
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorBatchTest) {
+    batchTest<std::vector<FixedAllocatorRange<uint32_t>>, defaults::SizeHeaderBlockFormat>(1);
+    batchTest<std::vector<FixedAllocatorRange<uint32_t>>, defaults::BoundaryTagBlockFormat>(2);
+    batchTest<FixedAllocatorRangeTree<uint32_t>, defaults::SizeHeaderBlockFormat>(3);
+    batchTest<FixedAllocatorTlsfRanges<uint32_t>, defaults::BoundaryTagBlockFormat>(4);
+}
+
+template <typename RangeVectorType, typename BlockFormat>
+void reallocTest(uint32_t seed) {
+    FormatTestArena<RangeVectorType, BlockFormat> arena;
+    auto& vectorBuffer = arena.vectorBuffer;
+    auto& fixedAllocator = arena.fixedAllocator;
+
+    //
+    // Grows into the free range after the block, moves only when the neighbour is taken.
+    //
+
+    auto _0 = reinterpret_cast<uint8_t*>(fixedAllocator.alloc(32));
+    auto _1 = fixedAllocator.alloc(32);
+    memset(_0, 0xab, 32);
+    EXPECT_NO_THROW(fixedAllocator.free(_1)); EXPECT_TRUE(fixedAllocator.good());
+
+    EXPECT_TRUE(fixedAllocator.tryExpandInPlace(_0, 64)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_GE(fixedAllocator.allocationSize(_0), 64);
+    EXPECT_EQ(fixedAllocator.realloc(_0, 256), _0); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_TRUE(fixedAllocator.shrinkInPlace(_0, 16)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_LT(fixedAllocator.allocationSize(_0), 256);
+    EXPECT_EQ(fixedAllocator.totalOccupiedSpace(), fixedAllocator.allocationSize(_0) + fixedAllocator.headerSize + fixedAllocator.trailerSize);
+
+    auto _2 = fixedAllocator.alloc(64);
+    EXPECT_FALSE(fixedAllocator.tryExpandInPlace(_0, 4096)); EXPECT_TRUE(fixedAllocator.good());
+    auto _3 = reinterpret_cast<uint8_t*>(fixedAllocator.realloc(_0, 4096)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_NE(_3, _0);
+    for (size_t i = 0; i < 16; ++i) { EXPECT_EQ(_3[i], 0xab); }
+
+    EXPECT_NO_THROW(fixedAllocator.free(_2)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.realloc(_3, 0), nullptr); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+
+    //
+    // Appending buffers keep their contents through every realloc.
+    //
+
+    std::mt19937 rng(seed);
+    std::vector<std::pair<uint8_t*, uint32_t>> allocations = {};
+    for (size_t r = 0; r < 4096; ++r) {
+        size_t op = rng() % 4;
+        if (allocations.empty() || op == 0) {
+            uint32_t size = 1 + rng() % 64;
+            auto p = reinterpret_cast<uint8_t*>(fixedAllocator.alloc(size));
+            if (p) {
+                memset(p, uint8_t(size), size);
+                allocations.emplace_back(p, size);
+            }
+        } else if (op == 3) {
+            size_t i = rng() % allocations.size();
+            EXPECT_NO_THROW(fixedAllocator.free(allocations[i].first)); EXPECT_TRUE(fixedAllocator.good());
+            allocations[i] = allocations.back();
+            allocations.pop_back();
+        } else {
+            size_t i = rng() % allocations.size();
+            uint32_t size = op == 1 ? allocations[i].second + 1 + rng() % 128 : 1 + rng() % allocations[i].second;
+            auto p = reinterpret_cast<uint8_t*>(fixedAllocator.realloc(allocations[i].first, size)); EXPECT_TRUE(fixedAllocator.good());
+            if (!p) { continue; }
+
+            uint32_t keptSize = std::min(size, allocations[i].second);
+            uint8_t pattern = uint8_t(allocations[i].second);
+            for (uint32_t j = 0; j < keptSize; ++j) { EXPECT_EQ(p[j], pattern); }
+
+            memset(p, uint8_t(size), size);
+            allocations[i] = {p, size};
+        }
+    }
+
+    for (auto& a : allocations) { EXPECT_NO_THROW(fixedAllocator.free(a.first)); EXPECT_TRUE(fixedAllocator.good()); }
+    EXPECT_EQ(fixedAllocator.freeBufferRanges.size(), 1);
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorReallocTest) {
+    reallocTest<std::vector<FixedAllocatorRange<uint32_t>>, defaults::SizeHeaderBlockFormat>(1);
+    reallocTest<std::vector<FixedAllocatorRange<uint32_t>>, defaults::BoundaryTagBlockFormat>(2);
+    reallocTest<FixedAllocatorRangeTree<uint32_t>, defaults::SizeHeaderBlockFormat>(3);
+    reallocTest<FixedAllocatorRangeTree<uint32_t>, defaults::BoundaryTagBlockFormat>(4);
+    reallocTest<FixedAllocatorTlsfRanges<uint32_t>, defaults::SizeHeaderBlockFormat>(5);
+    reallocTest<FixedAllocatorTlsfRanges<uint32_t>, defaults::BoundaryTagBlockFormat>(6);
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorStatsTest) {
+    std::vector<uint8_t> vectorBuffer(1024 * 64, 0);
+    FixedAllocator<uint32_t, ByteSpan> fixedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+
+    auto stats = fixedAllocator.stats();
+    EXPECT_EQ(stats.capacity, vectorBuffer.size());
+    EXPECT_EQ(stats.freeBytes, vectorBuffer.size());
+    EXPECT_EQ(stats.largestFreeBlock, vectorBuffer.size());
+    EXPECT_EQ(stats.freeRangeCount, 1);
+    EXPECT_EQ(stats.fragmentation(), 0.0);
+
+    auto _0 = fixedAllocator.alloc(100);
+    auto _1 = fixedAllocator.alloc(200);
+    auto _2 = fixedAllocator.alloc(300);
+    EXPECT_NO_THROW(fixedAllocator.free(_1));
+
+    stats = fixedAllocator.stats();
+    EXPECT_EQ(stats.liveAllocations, 2);
+    EXPECT_EQ(stats.freeRangeCount, 2);
+    EXPECT_EQ(stats.occupiedBytes, 100 + 300 + 2 * fixedAllocator.headerSize);
+    EXPECT_EQ(stats.highWaterMark, 100 + 200 + 300 + 3 * fixedAllocator.headerSize);
+    EXPECT_GT(stats.fragmentation(), 0.0);
+
+    EXPECT_NO_THROW(fixedAllocator.free(_0));
+
+    //
+    // Freeing the chunk range directly keeps the counters in step as well.
+    //
+
+    auto _2Offset = static_cast<uint32_t>(reinterpret_cast<uint8_t*>(_2) - vectorBuffer.data() - fixedAllocator.headerSize);
+    EXPECT_TRUE(fixedAllocator.freeRange({_2Offset, 300 + fixedAllocator.headerSize}));
+    EXPECT_FALSE(fixedAllocator.freeRange({_2Offset, 300 + fixedAllocator.headerSize}));
+    stats = fixedAllocator.stats();
+    EXPECT_EQ(stats.liveAllocations, 0);
+    EXPECT_EQ(stats.freeBytes, vectorBuffer.size());
+    EXPECT_EQ(stats.highWaterMark, 100 + 200 + 300 + 3 * fixedAllocator.headerSize);
+
+    //
+    // The largest free block is never above the real one and at most 1/8 below it.
+    //
+
+    std::mt19937 rng(7);
+    std::vector<void*> allocations = {};
+    for (size_t r = 0; r < 4096; ++r) {
+        if (allocations.empty() || rng() % 2) {
+            void* p = fixedAllocator.alloc(1 + rng() % 512);
+            if (p) { allocations.push_back(p); }
+        } else {
+            size_t i = rng() % allocations.size();
+            EXPECT_NO_THROW(fixedAllocator.free(allocations[i])); EXPECT_TRUE(fixedAllocator.good());
+            allocations[i] = allocations.back();
+            allocations.pop_back();
+        }
+
+        size_t largest = 0;
+        fixedAllocator.freeBufferRanges.forEachRange([&](const FixedAllocatorRange<uint32_t>& fr) { largest = std::max<size_t>(largest, fr.size); });
+
+        stats = fixedAllocator.stats();
+        EXPECT_EQ(stats.liveAllocations, allocations.size());
+        EXPECT_LE(stats.largestFreeBlock, largest);
+        EXPECT_GE(stats.largestFreeBlock * 8, largest * 7);
+        EXPECT_GE(stats.highWaterMark, stats.occupiedBytes);
+    }
+
+    EXPECT_NO_THROW(fixedAllocator.freeBatch(allocations.data(), allocations.size())); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.stats().liveAllocations, 0);
+    EXPECT_EQ(fixedAllocator.stats().fragmentation(), 0.0);
+
+    //
+    // Inserts keep the largest free block exact, sizes between class bounds included.
+    //
+
+    auto _3 = fixedAllocator.alloc(100);
+    auto _4 = fixedAllocator.alloc(200);
+    auto _5 = fixedAllocator.alloc(300);
+    EXPECT_NO_THROW(fixedAllocator.free(_4));
+
+    const size_t tailSize = vectorBuffer.size() - 100 - 200 - 300 - 3 * fixedAllocator.headerSize;
+    EXPECT_EQ(fixedAllocator.stats().largestFreeBlock, tailSize);
+    EXPECT_NO_THROW(fixedAllocator.free(fixedAllocator.alloc(1000)));
+    EXPECT_EQ(fixedAllocator.stats().largestFreeBlock, tailSize);
+
+    //
+    // Erasing it without a larger insert falls back to the size class, never above the real size.
+    //
+
+    auto _6 = fixedAllocator.alloc(static_cast<uint32_t>(tailSize / 2));
+    const size_t remainingSize = tailSize - tailSize / 2 - fixedAllocator.headerSize;
+    EXPECT_LE(fixedAllocator.stats().largestFreeBlock, remainingSize);
+    EXPECT_GE(fixedAllocator.stats().largestFreeBlock * 8, remainingSize * 7);
+    EXPECT_NO_THROW(fixedAllocator.free(_6));
+    EXPECT_EQ(fixedAllocator.stats().largestFreeBlock, tailSize);
+
+    EXPECT_NO_THROW(fixedAllocator.free(_3));
+    EXPECT_NO_THROW(fixedAllocator.free(_5));
+    EXPECT_EQ(fixedAllocator.stats().largestFreeBlock, vectorBuffer.size());
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorInstrumentationTest) {
+    using InstrumentedAllocator = FixedAllocator<uint32_t,
+                                                 ByteSpan,
+                                                 std::vector<FixedAllocatorRange<uint32_t>>,
+                                                 defaults::DefaultExceptionPolicy,
+                                                 defaults::DefaultMultiThreadedLockPolicy,
+                                                 defaults::FirstFitPolicy,
+                                                 defaults::SizeHeaderBlockFormat,
+                                                 defaults::HistogramInstrumentationPolicy<1>>;
+
+    std::vector<uint8_t> vectorBuffer(1024, 0);
+    InstrumentedAllocator fixedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+
+    auto _0 = fixedAllocator.alloc(10);
+    auto _1 = fixedAllocator.alloc(100);
+    auto _2 = fixedAllocator.alloc(2000);
+    EXPECT_EQ(_2, nullptr);
+    EXPECT_NO_THROW(fixedAllocator.free(_0));
+    auto _3 = fixedAllocator.alloc(500);
+    EXPECT_NO_THROW(fixedAllocator.free(_1));
+    EXPECT_NO_THROW(fixedAllocator.free(_3));
+
+    auto snapshot = fixedAllocator.instrumentation.snapshot();
+    EXPECT_EQ(snapshot.allocSizes.count, 3);
+    EXPECT_EQ(snapshot.allocSizes.sum, 10 + 100 + 500);
+    EXPECT_EQ(snapshot.allocSizes.buckets[FixedAllocatorHistogram::bucketOf(100)], 1);
+    EXPECT_EQ(snapshot.freeSizes.count, 3);
+    EXPECT_EQ(snapshot.failedAllocs, 1);
+    EXPECT_EQ(snapshot.probes.count, 4);
+    EXPECT_EQ(snapshot.probes.sum, 1 + 1 + 1 + 2);
+    EXPECT_EQ(snapshot.lockWaitNs.count, 7);
+    EXPECT_EQ(snapshot.allocLatencyNs.count, 4);
+    EXPECT_EQ(snapshot.freeLatencyNs.count, 3);
+
+    std::ostringstream metrics;
+    exportMetrics(metrics, fixedAllocator, "test_allocator");
+
+    std::string text = metrics.str();
+    EXPECT_NE(text.find("test_allocator_free_bytes 1024\n"), std::string::npos);
+    EXPECT_NE(text.find("test_allocator_failed_allocs_total 1\n"), std::string::npos);
+    EXPECT_NE(text.find("test_allocator_alloc_size_bytes_bucket{le=\"127\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("test_allocator_alloc_size_bytes_count 3\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE test_allocator_lock_wait_ns histogram\n"), std::string::npos);
+
+    //
+    // An exhausted arena counts its failures too, a batch is timed as one call.
+    //
+
+    std::vector<uint8_t> smallBuffer(64, 0);
+    InstrumentedAllocator smallAllocator(ByteSpan(smallBuffer.data(), smallBuffer.size()));
+    auto _4 = smallAllocator.alloc(64 - smallAllocator.headerSize);
+    EXPECT_NE(_4, nullptr);
+    EXPECT_EQ(smallAllocator.alloc(8), nullptr);
+    EXPECT_EQ(smallAllocator.alloc(8), nullptr);
+    EXPECT_EQ(smallAllocator.instrumentation.snapshot().failedAllocs, 2);
+
+    EXPECT_NO_THROW(smallAllocator.free(_4));
+    uint32_t batchSizes[3] = {8, 8, 64};
+    void* batchPtrs[3] = {};
+    EXPECT_EQ(smallAllocator.allocBatch(batchSizes, 3, batchPtrs), 2);
+
+    snapshot = smallAllocator.instrumentation.snapshot();
+    EXPECT_EQ(snapshot.failedAllocs, 3);
+    EXPECT_EQ(snapshot.allocSizes.count, 3);
+    EXPECT_EQ(snapshot.allocLatencyNs.count, 4);
+    EXPECT_NO_THROW(smallAllocator.freeBatch(batchPtrs, 3));
+
+    //
+    // Without instrumentation only the statistics are exported.
+    //
+
+    FixedAllocator<uint32_t, ByteSpan> plainAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+    std::ostringstream plainMetrics;
+    exportMetrics(plainMetrics, plainAllocator);
+    EXPECT_NE(plainMetrics.str().find("tiny_fixed_allocator_live_allocations 0\n"), std::string::npos);
+    EXPECT_EQ(plainMetrics.str().find("histogram"), std::string::npos);
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorStlTest) {
+    std::vector<uint8_t> vectorBuffer(1 << 16, 0);
+    FixedAllocator<uint32_t, ByteSpan> fixedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+
+    {
+        using IntAllocator = FixedStlAllocator<int, FixedAllocator<uint32_t, ByteSpan>>;
+        using PairAllocator = FixedStlAllocator<std::pair<const int, int>, FixedAllocator<uint32_t, ByteSpan>>;
+
+        std::vector<int, IntAllocator> values{IntAllocator(fixedAllocator)};
+        for (int i = 0; i < 100; ++i) { values.push_back(i); }
+
+        std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, PairAllocator> map{PairAllocator(fixedAllocator)};
+        for (int i = 0; i < 100; ++i) { map[i] = i * i; }
+
+        EXPECT_EQ(values[42], 42);
+        EXPECT_EQ(map[9], 81);
+        EXPECT_EQ(IntAllocator(fixedAllocator), PairAllocator(fixedAllocator));
+        EXPECT_GT(fixedAllocator.totalOccupiedSpace(), 100 * sizeof(int));
+        EXPECT_TRUE(fixedAllocator.good());
+
+        IntAllocator intAllocator(fixedAllocator);
+        EXPECT_THROW((void)intAllocator.allocate(1 << 20), std::bad_alloc);
+    }
+
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+
+#if defined(APEMODE_FIXED_ALLOCATOR_HAS_PMR)
+    {
+        using MultiThreadedAllocator = FixedAllocator<uint32_t,
+                                                      ByteSpan,
+                                                      std::vector<FixedAllocatorRange<uint32_t>>,
+                                                      defaults::DefaultExceptionPolicy,
+                                                      defaults::FutexLockPolicy>;
+
+        MultiThreadedAllocator multiThreadedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+        FixedAllocatorResource<MultiThreadedAllocator> resource(multiThreadedAllocator);
+
+        void* aligned = resource.allocate(100, 256);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) & 255, 0);
+        resource.deallocate(aligned, 100, 256);
+
+        std::pmr::vector<std::pmr::string> strings(&resource);
+        for (int i = 0; i < 50; ++i) { strings.emplace_back(std::string(64, char('a' + i % 26))); }
+
+        EXPECT_EQ(strings[27], std::pmr::string(64, 'b'));
+        EXPECT_GT(multiThreadedAllocator.totalOccupiedSpace(), 50 * 64);
+        EXPECT_THROW((void)resource.allocate(1 << 20, 8), std::bad_alloc);
+
+        FixedAllocatorResource<MultiThreadedAllocator> otherResource(multiThreadedAllocator);
+        EXPECT_TRUE(resource.is_equal(otherResource));
+        EXPECT_FALSE(resource.is_equal(*std::pmr::new_delete_resource()));
+
+        strings = {};
+        strings.shrink_to_fit();
+        EXPECT_EQ(multiThreadedAllocator.totalFreeSpace(), vectorBuffer.size());
+        EXPECT_TRUE(multiThreadedAllocator.good());
+    }
+#endif
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorHeaderlessTest) {
+    using HeaderlessAllocator = FixedAllocator<uint32_t,
+                                               ByteSpan,
+                                               std::vector<FixedAllocatorRange<uint32_t>>,
+                                               defaults::DefaultExceptionPolicy,
+                                               defaults::DefaultSingleThreadedLockPolicy,
+                                               defaults::FirstFitPolicy,
+                                               defaults::HeaderlessBlockFormat<true>>;
+
+    std::vector<uint8_t> vectorBuffer(1024, 0);
+    HeaderlessAllocator fixedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+
+    //
+    // Blocks are packed back to back, without headers.
+    //
+
+    auto _0 = reinterpret_cast<uint8_t*>(fixedAllocator.alloc(16));
+    auto _1 = reinterpret_cast<uint8_t*>(fixedAllocator.alloc(32));
+    auto _2 = reinterpret_cast<uint8_t*>(fixedAllocator.allocAligned(24, 64));
+    EXPECT_EQ(_0, vectorBuffer.data());
+    EXPECT_EQ(_1, _0 + 16);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(_2) & 63, 0);
+    EXPECT_EQ(fixedAllocator.totalOccupiedSpace(), 16 + 32 + 24);
+
+    //
+    // Mismatched sizes and double frees are caught by the out-of-band sizes.
+    //
+
+    EXPECT_THROW(fixedAllocator.free(_1, 16), std::runtime_error);
+    EXPECT_THROW(fixedAllocator.free(_1, 64), std::runtime_error);
+    EXPECT_NO_THROW(fixedAllocator.free(_1, 32));
+    EXPECT_THROW(fixedAllocator.free(_1, 32), std::runtime_error);
+    EXPECT_TRUE(fixedAllocator.good());
+
+    EXPECT_NO_THROW(fixedAllocator.free(_0, 16));
+    EXPECT_NO_THROW(fixedAllocator.free(_2, 24));
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+    EXPECT_TRUE(fixedAllocator.good());
+
+    //
+    // Sized deallocation through the STL adapter.
+    //
+
+    {
+        using IntAllocator = FixedStlAllocator<int, HeaderlessAllocator>;
+        std::vector<int, IntAllocator> values{IntAllocator(fixedAllocator)};
+        for (int i = 0; i < 64; ++i) { values.push_back(i); }
+        EXPECT_EQ(fixedAllocator.totalOccupiedSpace(), values.capacity() * sizeof(int));
+    }
+
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+    EXPECT_TRUE(fixedAllocator.good());
+
+    //
+    // Header formats accept the size and ignore it.
+    //
+
+    FixedAllocator<uint32_t, ByteSpan> headerAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+    auto _3 = headerAllocator.alloc(100);
+    EXPECT_NO_THROW(headerAllocator.free(_3, 100));
+    EXPECT_EQ(headerAllocator.totalFreeSpace(), vectorBuffer.size());
+}
+
+#if defined(APEMODE_FIXED_ALLOCATOR_HAS_MMAP)
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorPersistentArenaTest) {
+    using TaggedAllocator = FixedAllocator<uint32_t,
+                                           ByteSpan,
+                                           FixedAllocatorTlsfRanges<uint32_t>,
+                                           defaults::DefaultExceptionPolicy,
+                                           defaults::DefaultSingleThreadedLockPolicy,
+                                           defaults::FirstFitPolicy,
+                                           defaults::BoundaryTagBlockFormat>;
+
+    struct Node {
+        uint64_t next;
+        uint32_t value;
+    };
+
+    auto markDirty = [](const std::string& path) {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        uint32_t cleanShutdown = 0;
+        file.seekp(offsetof(PersistentArenaHeader, cleanShutdown));
+        file.write(reinterpret_cast<const char*>(&cleanShutdown), sizeof(cleanShutdown));
+    };
+
+    std::string path = testing::TempDir() + "TinyFixedAllocatorPersistentArenaTest.arena";
+    std::remove(path.c_str());
+
+    //
+    // Build a linked list in a new arena, leaving holes between the nodes.
+    //
+
+    size_t freeSpace = 0;
+    {
+        PersistentFixedArena<TaggedAllocator> arena(path, 1 << 16);
+        EXPECT_EQ(arena.state, PersistentArenaState::Created);
+
+        uint64_t head = PersistentArenaHeader::nullOffset;
+        for (uint32_t i = 0; i < 100; ++i) {
+            void* hole = arena.allocator->alloc(24);
+            auto node = static_cast<Node*>(arena.allocator->alloc(sizeof(Node)));
+            node->next = head;
+            node->value = i;
+            head = arena.offsetOf(node);
+            if (i % 2) { arena.allocator->free(hole); }
+        }
+
+        arena.setRoot(arena.at(head));
+        freeSpace = arena.allocator->totalFreeSpace();
+    }
+
+    auto sumList = [](PersistentFixedArena<TaggedAllocator>& arena) {
+        uint32_t sum = 0, count = 0;
+        for (auto node = static_cast<Node*>(arena.root()); node; node = static_cast<Node*>(arena.at(node->next))) {
+            sum += node->value;
+            ++count;
+        }
+
+        return count == 100 ? sum : 0;
+    };
+
+    //
+    // A clean restart restores the free ranges, a crash rebuilds them from the boundary tags.
+    //
+
+    {
+        PersistentFixedArena<TaggedAllocator> arena(path, 0);
+        EXPECT_EQ(arena.state, PersistentArenaState::Restored);
+        EXPECT_EQ(sumList(arena), 99 * 100 / 2);
+        EXPECT_EQ(arena.allocator->totalFreeSpace(), freeSpace);
+        EXPECT_EQ(arena.allocator->stats().liveAllocations, 150);
+        EXPECT_TRUE(arena.allocator->good());
+
+        void* p = arena.allocator->alloc(16);
+        EXPECT_NO_THROW(arena.allocator->free(p));
+        EXPECT_THROW(arena.allocator->free(p), std::runtime_error);
+    }
+
+    {
+        PersistentFixedArena<TaggedAllocator> arena(path, 0);
+        EXPECT_EQ(arena.allocator->stats().liveAllocations, 150);
+
+        void* extra = arena.allocator->alloc(1000);
+        EXPECT_NE(extra, nullptr);
+        freeSpace = arena.allocator->totalFreeSpace();
+    }
+
+    markDirty(path);
+
+    {
+        PersistentFixedArena<TaggedAllocator> arena(path, 0);
+        EXPECT_EQ(arena.state, PersistentArenaState::Recovered);
+        EXPECT_EQ(arena.allocator->totalFreeSpace(), freeSpace);
+        EXPECT_EQ(arena.allocator->stats().liveAllocations, 151);
+        EXPECT_TRUE(arena.allocator->good());
+    }
+
+    //
+    // Size headers cannot be walked without the free range table, a dirty arena does not open.
+    // Neither does an arena created with another block format.
+    //
+
+    using HeaderAllocator = FixedAllocator<uint32_t, ByteSpan>;
+    EXPECT_THROW(PersistentFixedArena<HeaderAllocator>(path, 0), std::runtime_error);
+
+    std::string headerPath = testing::TempDir() + "TinyFixedAllocatorPersistentArenaTest.header.arena";
+    std::remove(headerPath.c_str());
+
+    {
+        PersistentFixedArena<HeaderAllocator> arena(headerPath, 4096);
+        arena.setRoot(arena.allocator->alloc(100));
+    }
+
+    {
+        PersistentFixedArena<HeaderAllocator> arena(headerPath, 0);
+        EXPECT_EQ(arena.state, PersistentArenaState::Restored);
+        EXPECT_EQ(arena.allocator->allocationSize(arena.root()), 100);
+        EXPECT_EQ(arena.allocator->totalOccupiedSpace(), 100 + sizeof(uint32_t));
+    }
+
+    markDirty(headerPath);
+    EXPECT_THROW(PersistentFixedArena<HeaderAllocator>(headerPath, 0), std::runtime_error);
+
+    std::remove(path.c_str());
+    std::remove(headerPath.c_str());
+}
+
+#endif
+
+#if defined(APEMODE_FIXED_ALLOCATOR_HAS_SHM)
+
+#include <sys/wait.h>
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorSharedMemoryTest) {
+    using Arena = SharedMemoryArena<uint32_t, 64>;
+    using RangeTable = FixedCapacityVector<FixedAllocatorRange<uint32_t>, 64>;
+    static_assert(sizeof(FixedAllocatorRangeVector<uint32_t, RangeTable>) == sizeof(RangeTable), "One inline range table per arena.");
+
+    std::string name = "/TinyFixedAllocatorTest." + std::to_string(getpid());
+    Arena::unlink(name);
+
+    Arena arena(name, 1 << 16);
+    EXPECT_THROW(Arena(name, 1 << 16), std::runtime_error);
+
+    auto runChild = [](auto&& fn) {
+        pid_t pid = fork();
+        if (pid == 0) { _exit(fn() ? 0 : 1); }
+
+        int status = -1;
+        waitpid(pid, &status, 0);
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    };
+
+    //
+    // Another process maps the segment at its own address, allocates a payload and publishes its offset.
+    //
+
+    EXPECT_TRUE(runChild([&]() {
+        Arena childArena(name);
+        auto payload = static_cast<uint8_t*>(childArena.alloc(1000));
+        if (!payload || childArena.heap() == arena.heap()) { return false; }
+
+        for (uint32_t i = 0; i < 1000; ++i) { payload[i] = uint8_t(i * 7); }
+        childArena.setRoot(payload);
+        return true;
+    }));
+
+    auto payload = static_cast<uint8_t*>(arena.root());
+    ASSERT_NE(payload, nullptr);
+
+    bool payloadMatches = true;
+    for (uint32_t i = 0; i < 1000; ++i) { payloadMatches &= payload[i] == uint8_t(i * 7); }
+    EXPECT_TRUE(payloadMatches);
+    EXPECT_EQ(arena.allocator->allocationSize(payload), 1000);
+    EXPECT_NO_THROW(arena.free(payload));
+    EXPECT_EQ(arena.allocator->totalFreeSpace(), arena.header->heapSize);
+
+    //
+    // A process that dies holding the lock does not block the others.
+    //
+
+    EXPECT_TRUE(runChild([&]() {
+        Arena childArena(name);
+        childArena.allocator->lock.lock();
+        _exit(0);
+        return true;
+    }));
+
+    void* p = arena.alloc(10);
+    EXPECT_NE(p, nullptr);
+    EXPECT_EQ(arena.ownerDeaths(), 1);
+    EXPECT_NO_THROW(arena.free(p));
+    EXPECT_TRUE(arena.allocator->good());
+
+    //
+    // The range table bounds the number of live blocks, fragmenting the heap never overflows it.
+    //
+
+    std::vector<void*> blocks = {};
+    while (void* block = arena.alloc(16)) { blocks.push_back(block); }
+    EXPECT_EQ(blocks.size(), Arena::maxLiveBlocks);
+
+    for (size_t i = 0; i < blocks.size(); i += 2) { arena.free(blocks[i]); }
+    EXPECT_TRUE(arena.allocator->good());
+    for (size_t i = 1; i < blocks.size(); i += 2) { arena.free(blocks[i]); }
+    EXPECT_EQ(arena.allocator->totalFreeSpace(), arena.header->heapSize);
+    EXPECT_TRUE(arena.allocator->good());
+
+    Arena::unlink(name);
+}
+
+#endif
+
+template <typename RangeVectorType, typename BlockFormat>
+void handleTest(uint32_t seed) {
+    FormatTestArena<RangeVectorType, BlockFormat> arena;
+    auto& vectorBuffer = arena.vectorBuffer;
+    auto& fixedAllocator = arena.fixedAllocator;
+    HandleFixedAllocator<FormatTestAllocator<RangeVectorType, BlockFormat>> handleAllocator(fixedAllocator);
+
+    //
+    // Fragment the arena until a large block does not fit anywhere.
+    //
+
+    std::mt19937 rng(seed);
+    std::vector<std::pair<FixedAllocatorHandle, uint32_t>> handles = {};
+    for (;;) {
+        uint32_t size = 16 + rng() % 112;
+        auto handle = handleAllocator.allocHandle(size);
+        if (!handle.valid()) { break; }
+
+        memset(handleAllocator.resolve(handle), uint8_t(handles.size()), size);
+        handles.emplace_back(handle, size);
+    }
+
+    std::vector<std::pair<FixedAllocatorHandle, uint32_t>> liveHandles = {};
+    for (size_t i = 0; i < handles.size(); ++i) {
+        if (i % 2) {
+            EXPECT_NO_THROW(handleAllocator.freeHandle(handles[i].first));
+            EXPECT_EQ(handleAllocator.resolve(handles[i].first), nullptr);
+        } else {
+            liveHandles.push_back(handles[i]);
+        }
+    }
+
+    EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_THROW(handleAllocator.freeHandle(handles[1].first), std::runtime_error);
+    EXPECT_EQ(handleAllocator.size(), liveHandles.size());
+
+    const uint32_t largeSize = fixedAllocator.totalFreeSpace() / 2;
+    EXPECT_EQ(fixedAllocator.allocByteSpan(largeSize).data(), nullptr);
+
+    auto checkContents = [&]() {
+        for (size_t i = 0; i < liveHandles.size(); ++i) {
+            auto p = reinterpret_cast<const uint8_t*>(handleAllocator.resolve(liveHandles[i].first));
+            ASSERT_NE(p, nullptr);
+            for (uint32_t j = 0; j < liveHandles[i].second; ++j) { ASSERT_EQ(p[j], uint8_t(i * 2)); }
+        }
+    };
+
+    //
+    // Pinned blocks stay in place and cannot be freed, an empty budget moves nothing.
+    //
+
+    std::vector<std::pair<FixedAllocatorHandle, void*>> pinnedHandles = {};
+    for (size_t i = 0; i < liveHandles.size(); i += liveHandles.size() / 4) {
+        pinnedHandles.emplace_back(liveHandles[i].first, handleAllocator.pin(liveHandles[i].first));
+    }
+
+    EXPECT_THROW(handleAllocator.freeHandle(pinnedHandles[0].first), std::runtime_error);
+    EXPECT_EQ(handleAllocator.compactStep(std::chrono::nanoseconds(0)), 0);
+    EXPECT_GT(handleAllocator.compactStep(std::chrono::milliseconds(100)), 0);
+    EXPECT_TRUE(fixedAllocator.good());
+    handleAllocator.compact();
+    EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_LE(fixedAllocator.freeBufferRanges.size(), pinnedHandles.size() + 1);
+    for (auto& pinned : pinnedHandles) { EXPECT_EQ(handleAllocator.resolve(pinned.first), pinned.second); }
+    checkContents();
+
+    //
+    // Unpinned, everything slides down and leaves one free range at the end of the arena.
+    //
+
+    for (auto& pinned : pinnedHandles) { handleAllocator.unpin(pinned.first); }
+    const uint32_t freeSpace = fixedAllocator.totalFreeSpace();
+    EXPECT_GT(handleAllocator.compact(), 0);
+    EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), freeSpace);
+    EXPECT_EQ(fixedAllocator.freeBufferRanges.size(), 1);
+    fixedAllocator.forEachFreeRange([&](const FixedAllocatorRange<uint32_t>& r) { EXPECT_EQ(r.offset + r.size, vectorBuffer.size()); });
+    checkContents();
+
+    auto largeSpan = fixedAllocator.allocByteSpan(largeSize);
+    EXPECT_NE(largeSpan.data(), nullptr);
+    EXPECT_NO_THROW(fixedAllocator.free(largeSpan.data())); EXPECT_TRUE(fixedAllocator.good());
+
+    for (auto& live : liveHandles) { EXPECT_NO_THROW(handleAllocator.freeHandle(live.first)); }
+    EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(handleAllocator.size(), 0);
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), vectorBuffer.size());
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorHandleTest) {
+    handleTest<std::vector<FixedAllocatorRange<uint32_t>>, defaults::SizeHeaderBlockFormat>(1);
+    handleTest<std::vector<FixedAllocatorRange<uint32_t>>, defaults::BoundaryTagBlockFormat>(2);
+    handleTest<FixedAllocatorRangeTree<uint32_t>, defaults::SizeHeaderBlockFormat>(3);
+    handleTest<FixedAllocatorRangeTree<uint32_t>, defaults::BoundaryTagBlockFormat>(4);
+    handleTest<FixedAllocatorTlsfRanges<uint32_t>, defaults::SizeHeaderBlockFormat>(5);
+    handleTest<FixedAllocatorTlsfRanges<uint32_t>, defaults::BoundaryTagBlockFormat>(6);
+}
+
+struct CountingSegmentSource {
+    std::shared_ptr<size_t> liveSegments = std::make_shared<size_t>(0);
+
+    uint8_t* acquire(size_t size) {
+        ++*liveSegments;
+        return new uint8_t[size];
+    }
+
+    void release(uint8_t* dataPtr, size_t) noexcept {
+        --*liveSegments;
+        delete[] dataPtr;
+    }
+};
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorSegmentedTest) {
+    using SegmentedAllocator = SegmentedFixedAllocator<FixedAllocator<uint32_t, ByteSpan>, CountingSegmentSource>;
+
+    std::vector<uint8_t> vectorBuffer(1024 * 4, 0);
+    CountingSegmentSource source;
+    SegmentedAllocator segmentedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()), source, 64);
+
+    //
+    // Grows geometrically instead of failing, every block stays where it was allocated.
+    //
+
+    std::mt19937 rng(1);
+    std::vector<std::pair<uint8_t*, uint32_t>> allocations = {};
+    while (segmentedAllocator.segmentCount() < 5) {
+        uint32_t size = 1 + rng() % 256;
+        auto p = reinterpret_cast<uint8_t*>(segmentedAllocator.alloc(size));
+        ASSERT_NE(p, nullptr);
+        memset(p, uint8_t(size), size);
+        allocations.emplace_back(p, size);
+    }
+
+    EXPECT_TRUE(segmentedAllocator.good());
+    EXPECT_EQ(*source.liveSegments, 4);
+    EXPECT_EQ(segmentedAllocator.capacity(), vectorBuffer.size() * (1 + 2 + 4 + 8 + 16));
+    EXPECT_EQ(segmentedAllocator.totalOccupiedSpace() + segmentedAllocator.totalFreeSpace(), segmentedAllocator.capacity());
+
+    auto large = segmentedAllocator.alloc(1024 * 1024);
+    EXPECT_NE(large, nullptr);
+    EXPECT_GE(segmentedAllocator.allocationSize(large), 1024 * 1024);
+    EXPECT_EQ(*source.liveSegments, 5);
+
+    uint32_t outOfBounds = 0;
+    EXPECT_THROW(segmentedAllocator.free(&outOfBounds), std::runtime_error);
+
+    for (auto& a : allocations) {
+        EXPECT_EQ(segmentedAllocator.allocationSize(a.first) >= a.second, true);
+        for (uint32_t j = 0; j < a.second; ++j) { ASSERT_EQ(a.first[j], uint8_t(a.second)); }
+    }
+
+    //
+    // The emptied segment outlives the next frees, then goes back to the source.
+    //
+
+    EXPECT_NO_THROW(segmentedAllocator.free(large, 1024 * 1024)); EXPECT_TRUE(segmentedAllocator.good());
+    EXPECT_EQ(*source.liveSegments, 5);
+
+    std::shuffle(allocations.begin(), allocations.end(), rng);
+    for (size_t i = 0; i < 32; ++i) {
+        EXPECT_NO_THROW(segmentedAllocator.free(allocations.back().first));
+        allocations.pop_back();
+    }
+
+    EXPECT_EQ(*source.liveSegments, 5);
+
+    for (auto& a : allocations) { EXPECT_NO_THROW(segmentedAllocator.free(a.first)); }
+    EXPECT_TRUE(segmentedAllocator.good());
+    EXPECT_LT(*source.liveSegments, 5);
+
+    segmentedAllocator.trim();
+    EXPECT_EQ(*source.liveSegments, 0);
+    EXPECT_EQ(segmentedAllocator.segmentCount(), 1);
+    EXPECT_EQ(segmentedAllocator.totalFreeSpace(), vectorBuffer.size());
+
+    //
+    // Growth resumes from the last segment size, the destructor releases what is left.
+    //
+
+    {
+        SegmentedAllocator scopedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()), source);
+        EXPECT_NE(scopedAllocator.alloc(1024 * 8), nullptr);
+        EXPECT_EQ(*source.liveSegments, 1);
+    }
+
+    EXPECT_EQ(*source.liveSegments, 0);
+
+    //
+    // The active segment and the last one are both released by one trim(), the caller's segment takes over.
+    // The source hands out the first segment above the caller's buffer and the second one below it.
+    //
+
+    struct PoolSegmentSource {
+        uint8_t* low = nullptr;
+        uint8_t* high = nullptr;
+        size_t acquired = 0;
+        size_t released = 0;
+
+        uint8_t* acquire(size_t) { return acquired++ ? low : high; }
+        void release(uint8_t*, size_t) noexcept { ++released; }
+    };
+
+    std::vector<uint8_t> poolBuffer(64 * 1024, 0);
+    uint8_t* callerData = poolBuffer.data() + 32 * 1024;
+    PoolSegmentSource poolSource{poolBuffer.data(), callerData + 4096};
+
+    SegmentedFixedAllocator<FixedAllocator<uint32_t, ByteSpan>, PoolSegmentSource> poolAllocator(ByteSpan(callerData, 4096), poolSource, 1 << 20);
+    void* _0 = poolAllocator.alloc(3000);
+    void* _1 = poolAllocator.alloc(3000);
+    void* _2 = poolAllocator.alloc(7000);
+    EXPECT_EQ(poolAllocator.source.acquired, 2);
+    EXPECT_GT((uint8_t*)_1, callerData);
+    EXPECT_LT((uint8_t*)_2, callerData);
+
+    EXPECT_NO_THROW(poolAllocator.free(_0));
+    EXPECT_NO_THROW(poolAllocator.free(_1));
+    EXPECT_NO_THROW(poolAllocator.free(_2));
+    poolAllocator.trim();
+    EXPECT_EQ(poolAllocator.source.released, 2);
+    EXPECT_EQ(poolAllocator.segmentCount(), 1);
+
+    auto _3 = reinterpret_cast<uint8_t*>(poolAllocator.alloc(100));
+    EXPECT_TRUE(_3 >= callerData && _3 < callerData + 4096);
+    EXPECT_NO_THROW(poolAllocator.free(_3)); EXPECT_TRUE(poolAllocator.good());
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorLinearTest) {
+    std::vector<uint8_t> vectorBuffer(1024 * 4, 0);
+    LinearFixedAllocator<uint32_t> linearAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+
+    //
+    // Blocks are packed back to back, alignment pads only the aligned block.
+    //
+
+    auto _0 = reinterpret_cast<uint8_t*>(linearAllocator.alloc(3));
+    auto _1 = reinterpret_cast<uint8_t*>(linearAllocator.alloc(5));
+    EXPECT_EQ(_0, vectorBuffer.data());
+    EXPECT_EQ(_1, _0 + 3);
+
+    auto _2 = linearAllocator.allocAligned(16, 64);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(_2) % 64, 0);
+    EXPECT_EQ(linearAllocator.totalOccupiedSpace(), reinterpret_cast<uint8_t*>(_2) + 16 - vectorBuffer.data());
+
+    //
+    // Sized frees pop the top block only, rewind() and reset() drop everything after the marker.
+    //
+
+    auto marker = linearAllocator.mark();
+    auto _3 = linearAllocator.alloc(100);
+    auto _4 = linearAllocator.alloc(200);
+    EXPECT_NO_THROW(linearAllocator.free(_3, 100));
+    EXPECT_EQ(linearAllocator.totalOccupiedSpace(), marker.offset + 300);
+    EXPECT_NO_THROW(linearAllocator.free(_4, 200));
+    EXPECT_EQ(linearAllocator.totalOccupiedSpace(), marker.offset + 100);
+
+    linearAllocator.rewind(marker);
+    EXPECT_EQ(linearAllocator.totalOccupiedSpace(), marker.offset);
+    EXPECT_EQ(linearAllocator.alloc(100), _3);
+
+    {
+        LinearAllocatorScope<LinearFixedAllocator<uint32_t>> scope(linearAllocator);
+        EXPECT_NE(linearAllocator.alloc(1000), nullptr);
+        EXPECT_EQ(linearAllocator.alloc(4096), nullptr);
+    }
+
+    EXPECT_EQ(linearAllocator.totalOccupiedSpace(), marker.offset + 100);
+    EXPECT_THROW(linearAllocator.free(vectorBuffer.data() + 2048), std::runtime_error);
+
+    //
+    // Zero-size blocks sit at the top and are freed like any other block.
+    //
+
+    auto _5 = reinterpret_cast<uint8_t*>(linearAllocator.alloc(0));
+    EXPECT_EQ(_5, vectorBuffer.data() + linearAllocator.totalOccupiedSpace());
+    EXPECT_NO_THROW(linearAllocator.free(_5));
+    EXPECT_NO_THROW(linearAllocator.free(_5, 0));
+    EXPECT_EQ(linearAllocator.totalOccupiedSpace(), marker.offset + 100);
+
+    linearAllocator.reset();
+    EXPECT_EQ(linearAllocator.totalFreeSpace(), vectorBuffer.size());
+    EXPECT_EQ(linearAllocator.alloc(4096), vectorBuffer.data());
+    EXPECT_EQ(linearAllocator.alloc(1), nullptr);
+    EXPECT_EQ(linearAllocator.highWaterMark, vectorBuffer.size());
+    EXPECT_TRUE(linearAllocator.good());
+
+    //
+    // Frames carved out of a FixedAllocator block go back to it, STL containers run on top of a frame.
+    //
+
+    std::vector<uint8_t> fixedBuffer(1024 * 64, 0);
+    FixedAllocator<uint32_t, ByteSpan> fixedAllocator(ByteSpan(fixedBuffer.data(), fixedBuffer.size()));
+    {
+        FixedAllocatorFrame<FixedAllocator<uint32_t, ByteSpan>> frame(fixedAllocator, 1024 * 16);
+        EXPECT_EQ(frame.totalFreeSpace(), 1024 * 16);
+        EXPECT_EQ(fixedAllocator.stats().liveAllocations, 1);
+
+        using FrameAllocator = LinearFixedAllocator<uint32_t, ByteSpan, defaults::DefaultExceptionPolicy>;
+        std::vector<uint32_t, FixedStlAllocator<uint32_t, FrameAllocator>> values{FixedStlAllocator<uint32_t, FrameAllocator>(frame)};
+        for (uint32_t i = 0; i < 1024; ++i) { values.push_back(i); }
+        for (uint32_t i = 0; i < 1024; ++i) { EXPECT_EQ(values[i], i); }
+        EXPECT_TRUE(frame.owns(values.data()));
+    }
+
+    EXPECT_EQ(fixedAllocator.stats().liveAllocations, 0);
+    EXPECT_TRUE(fixedAllocator.good());
+
+    FixedAllocatorFrame<FixedAllocator<uint32_t, ByteSpan>> oversizedFrame(fixedAllocator, 1024 * 128);
+    EXPECT_EQ(oversizedFrame.alloc(1), nullptr);
+}
+
+template <size_t DrainThreshold>
+void ownedTest(uint32_t seed) {
+    using MultiThreadedAllocator = FixedAllocator<uint32_t,
+                                                  ByteSpan,
+                                                  std::vector<FixedAllocatorRange<uint32_t>>,
+                                                  defaults::DefaultExceptionPolicy,
+                                                  defaults::SharedSpinLockPolicy>;
+
+    std::vector<uint8_t> vectorBuffer(1024 * 256, 0);
+    MultiThreadedAllocator fixedAllocator(ByteSpan(vectorBuffer.data(), vectorBuffer.size()));
+    OwnedFixedAllocator<MultiThreadedAllocator, DrainThreshold> ownedAllocator(fixedAllocator);
+    EXPECT_TRUE(ownedAllocator.isOwner());
+
+    //
+    // The owner allocates, remote threads free, the owner keeps allocating while they do.
+    //
+
+    std::mt19937 rng(seed);
+    constexpr size_t threadCount = 4;
+    std::vector<std::vector<void*>> threadBlocks(threadCount);
+    for (size_t i = 0; i < 2048; ++i) {
+        uint32_t size = 1 + rng() % 64;
+        auto p = ownedAllocator.alloc(size);
+        ASSERT_NE(p, nullptr);
+        memset(p, 0xcd, size);
+        threadBlocks[i % threadCount].push_back(p);
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            EXPECT_FALSE(ownedAllocator.isOwner());
+            for (auto p : threadBlocks[t]) { ownedAllocator.free(p); }
+        });
+    }
+
+    std::vector<void*> ownerBlocks;
+    for (size_t i = 0; i < 256; ++i) { ownerBlocks.push_back(ownedAllocator.alloc(32)); }
+    for (auto& thread : threads) { thread.join(); }
+
+    EXPECT_TRUE(ownedAllocator.pendingFrees() < DrainThreshold || ownedAllocator.drainRequested.load());
+    EXPECT_TRUE(ownedAllocator.good());
+
+    //
+    // The next owner allocation drains what is left, owner frees bypass the queue.
+    //
+
+    auto p = ownedAllocator.alloc(1);
+    EXPECT_NE(p, nullptr);
+    EXPECT_EQ(ownedAllocator.pendingFrees(), 0);
+    EXPECT_GE(ownedAllocator.allocationSize(p), sizeof(void*));
+
+    EXPECT_NO_THROW(ownedAllocator.free(p));
+    for (auto b : ownerBlocks) { EXPECT_NO_THROW(ownedAllocator.free(b)); }
+    EXPECT_EQ(ownedAllocator.pendingFrees(), 0);
+    EXPECT_TRUE(ownedAllocator.good());
+    EXPECT_EQ(fixedAllocator.freeBufferRanges.size(), 1);
+    EXPECT_EQ(ownedAllocator.totalFreeSpace(), vectorBuffer.size());
+
+    //
+    // After adopt() the other thread is the owner.
+    //
+
+    auto q = ownedAllocator.alloc(16);
+    std::thread([&]() {
+        ownedAllocator.adopt();
+        ownedAllocator.free(q);
+        EXPECT_EQ(ownedAllocator.pendingFrees(), 0);
+    }).join();
+
+    EXPECT_FALSE(ownedAllocator.isOwner());
+    EXPECT_EQ(ownedAllocator.totalFreeSpace(), vectorBuffer.size());
+
+    //
+    // A remote free at the threshold only raises the flag, the owner drains on its next free.
+    //
+
+    ownedAllocator.adopt();
+    std::vector<void*> remoteBlocks;
+    for (size_t i = 0; i < DrainThreshold; ++i) { remoteBlocks.push_back(ownedAllocator.alloc(16)); }
+    auto r = ownedAllocator.alloc(16);
+
+    std::thread([&]() {
+        for (auto b : remoteBlocks) { ownedAllocator.free(b); }
+    }).join();
+
+    EXPECT_EQ(ownedAllocator.pendingFrees(), DrainThreshold);
+    EXPECT_TRUE(ownedAllocator.drainRequested.load());
+
+    EXPECT_NO_THROW(ownedAllocator.free(r));
+    EXPECT_EQ(ownedAllocator.pendingFrees(), 0);
+    EXPECT_FALSE(ownedAllocator.drainRequested.load());
+    EXPECT_EQ(ownedAllocator.totalFreeSpace(), vectorBuffer.size());
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorOwnedTest) {
+    ownedTest<1>(1);
+    ownedTest<64>(2);
+    ownedTest<4096>(3);
+}
+
+#if defined(__linux__)
+
+template <typename RangeVectorType, typename BlockFormat>
+void virtualMemoryTest(const VirtualMemoryOptions& options) {
+    constexpr size_t arenaSize = 64 << 20;
+    constexpr size_t blockSize = 256 << 10;
+    VirtualMemoryContainer container(arenaSize, options);
+    ASSERT_EQ(container.size(), arenaSize);
+    if (options.hugePages) { EXPECT_EQ(reinterpret_cast<uintptr_t>(container.data()) % VirtualMemoryContainer::hugePageSize, 0); }
+
+    //
+    // Nothing is committed until the blocks are touched.
+    //
+
+    const size_t granularity = options.hugePages ? VirtualMemoryContainer::hugePageSize : 4096;
+    FormatTestAllocator<RangeVectorType, BlockFormat, VirtualMemoryContainer> fixedAllocator(container);
+    EXPECT_LE(container.residentBytes(), 4 * granularity);
+
+    std::vector<uint8_t*> blocks;
+    for (size_t i = 0; i < 128; ++i) {
+        auto p = reinterpret_cast<uint8_t*>(fixedAllocator.alloc(blockSize));
+        ASSERT_NE(p, nullptr);
+        memset(p, uint8_t(i + 1), blockSize);
+        blocks.push_back(p);
+    }
+
+    EXPECT_GE(container.residentBytes(), blocks.size() * blockSize);
+
+    //
+    // Every other block is freed: the ranges are large enough to decommit (unless they hold no whole huge page),
+    // the live blocks keep their contents.
+    //
+
+    for (size_t i = 0; i < blocks.size(); i += 2) { EXPECT_NO_THROW(fixedAllocator.free(blocks[i])); }
+    EXPECT_TRUE(fixedAllocator.good());
+    if (!options.hugePages) { EXPECT_GE(container.decommittedBytes(), blocks.size() / 2 * (blockSize - 2 * granularity)); }
+    if (!options.lazyFree && !options.hugePages) { EXPECT_LT(container.residentBytes(), (blocks.size() / 2 + 8) * blockSize); }
+
+    for (size_t i = 1; i < blocks.size(); i += 2) {
+        for (size_t j = 0; j < blockSize; j += 4096) { ASSERT_EQ(blocks[i][j], uint8_t(i + 1)); }
+    }
+
+    //
+    // Small frees merge with their decommitted neighbours, the reused pages come back on touch.
+    //
+
+    auto small = reinterpret_cast<uint8_t*>(fixedAllocator.alloc(64));
+    memset(small, 0xee, 64);
+    EXPECT_NO_THROW(fixedAllocator.free(small)); EXPECT_TRUE(fixedAllocator.good());
+
+    void* batch[64] = {};
+    for (size_t i = 1; i < blocks.size(); i += 2) { batch[i / 2] = blocks[i]; }
+    EXPECT_NO_THROW(fixedAllocator.freeBatch(batch, 64)); EXPECT_TRUE(fixedAllocator.good());
+    EXPECT_EQ(fixedAllocator.totalFreeSpace(), arenaSize);
+    EXPECT_GE(container.decommittedBytes(), blocks.size() * blockSize - 4 * granularity);
+    if (!options.lazyFree) { EXPECT_LE(container.residentBytes(), 4 * granularity); }
+
+    auto reused = reinterpret_cast<uint8_t*>(fixedAllocator.alloc(arenaSize / 2));
+    ASSERT_NE(reused, nullptr);
+    memset(reused, 0x5a, arenaSize / 2);
+    EXPECT_NO_THROW(fixedAllocator.free(reused)); EXPECT_TRUE(fixedAllocator.good());
+}
+
+TEST_F(TinyFixedAllocatorTest, TinyFixedAllocatorVirtualMemoryTest) {
+    virtualMemoryTest<std::vector<FixedAllocatorRange<uint32_t>>, defaults::SizeHeaderBlockFormat>({});
+    virtualMemoryTest<FixedAllocatorRangeTree<uint32_t>, defaults::BoundaryTagBlockFormat>({});
+
+    //
+    // TLSF keeps its free list fields in band, a freed 256 KB block leaves slightly less than 256 KB to decommit.
+    //
+
+    virtualMemoryTest<FixedAllocatorTlsfRanges<uint32_t>, defaults::BoundaryTagBlockFormat>({false, true, 128 << 10});
+    virtualMemoryTest<std::vector<FixedAllocatorRange<uint32_t>>, defaults::BoundaryTagBlockFormat>({true, false});
+
+    //
+    // Prefaulted arenas are fully committed before the first allocation, a disabled threshold never decommits.
+    //
+
+    VirtualMemoryOptions options;
+    options.prefaultThreads = 4;
+    options.decommitThreshold = 0;
+
+    VirtualMemoryContainer container(16 << 20, options);
+    EXPECT_EQ(container.residentBytes(), container.size());
+
+    FixedAllocator<uint32_t, VirtualMemoryContainer> fixedAllocator(container);
+    EXPECT_NO_THROW(fixedAllocator.free(fixedAllocator.alloc(8 << 20)));
+    EXPECT_EQ(container.decommittedBytes(), 0);
+    EXPECT_EQ(container.residentBytes(), container.size());
+}
+
+#endif
+
 } // namespace